@@ -0,0 +1,89 @@
+struct clusterdata {
+    vec4 sphere;
+    vec4 cone;
+    uint firstindex;
+    uint count;
+    uint reserved0;
+    uint reserved1;
+};
+
+struct clusterjob {
+    uint drawid;
+    uint node;
+    uint firstcluster;
+    uint nclusters;
+    int basevertex;
+    uint reserved0;
+    uint reserved1;
+    uint reserved2;
+};
+
+struct drawcommand {
+    uint count;
+    uint instancecount;
+    uint firstindex;
+    int basevertex;
+    uint baseinstance;
+};
+
+struct instancedata {
+    uint drawid;
+    uint node;
+};
+
+struct nodedata {
+    mat4 world;
+    mat4 normal;
+};
+
+layout (local_size_x = localsize) in;
+layout (location = 0) uniform vec4 planes[6];
+layout (location = 6) uniform vec3 campos;
+layout (std430, binding = 2) readonly buffer Nodes {
+    nodedata nodes[];
+};
+layout (std430, binding = 3) readonly buffer Clusters {
+    clusterdata clusters[];
+};
+layout (std430, binding = 4) buffer Jobs {
+    uint nvisible;
+    uint njobs;
+    uint reserved0;
+    uint reserved1;
+    clusterjob jobs[];
+};
+layout (std430, binding = 5) writeonly buffer Commands {
+    drawcommand commands[];
+};
+layout (std430, binding = 6) writeonly buffer Instances {
+    instancedata instances[];
+};
+
+void main() {
+    uint job = gl_WorkGroupID.y;
+    uint c = gl_GlobalInvocationID.x;
+    if (job >= njobs || c >= jobs[job].nclusters)
+        return;
+    clusterdata cluster = clusters[jobs[job].firstcluster + c];
+    mat4 world = nodes[jobs[job].node].world;
+
+    /* bounding sphere in world space, scaled by the longest axis */
+    vec3 center = (world * vec4(cluster.sphere.xyz, 1.0)).xyz;
+    float radius = cluster.sphere.w * max(length(world[0].xyz), max(length(world[1].xyz), length(world[2].xyz)));
+
+    /* frustum, planes are normalized */
+    for (int i = 0; i < 6; ++i)
+        if (dot(planes[i].xyz, center) + planes[i].w < -radius)
+            return;
+
+    /* normal cone, every triangle faces away from any point the camera can be at */
+    vec3 axis = normalize(mat3(nodes[jobs[job].node].normal) * cluster.cone.xyz);
+    vec3 view = center - campos;
+    if (dot(view, axis) >= cluster.cone.w * length(view) + radius)
+        return;
+
+    /* append one command per surviving cluster with its own instance */
+    uint slot = atomicAdd(nvisible, 1u);
+    commands[slot] = drawcommand(cluster.count, 1u, cluster.firstindex, jobs[job].basevertex, slot);
+    instances[slot] = instancedata(jobs[job].drawid, jobs[job].node);
+}
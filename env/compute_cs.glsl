@@ -0,0 +1,130 @@
+#define pload(id) (imageLoad(particleImg, ivec2((id), instance)).r)
+#define pstore(id, v) imageStore(particleImg, ivec2((id), instance), vec4((v)))
+#define id_x 0
+#define id_y 1
+#define id_z 2
+#define id_vx 3
+#define id_vy 4
+#define id_vz 5
+#define id_ax 6
+#define id_ay 7
+#define id_az 8
+#define id_scale 9
+#define id_initialx 10
+#define id_initialy 11
+#define id_initialz 12
+#define id_initialvx 13
+#define id_initialvy 14
+#define id_initialvz 15
+
+#define integrator_euler 0
+#define integrator_semi 1
+#define integrator_verlet 2
+#define integrator_rk2 3
+#define field_attractor 0
+#define field_vortex 1
+#define field_gust 2
+#define field_repulsor 3
+#define fieldgrid_ncells (fieldgridres.x * fieldgridres.y * fieldgridres.z)
+
+struct forcefield {
+    vec4 posType;
+    vec4 dirStrength;
+    vec4 params;
+};
+
+layout (local_size_x = localsize) in;
+layout (binding = 0, r32f) uniform image2DRect particleImg;
+layout (location = 5) uniform float deltaTime;
+layout (location = 6) uniform float minY;
+layout (location = 7) uniform int nSteps;
+layout (location = 8) uniform float time; /* at the start of the first step */
+layout (std430, binding = 0) readonly buffer Fields { forcefield fields[]; };
+layout (std430, binding = 1) readonly buffer FieldCells { uvec2 fieldCells[]; };
+layout (std430, binding = 2) readonly buffer FieldIndices { uint fieldIndices[]; };
+
+vec3 fieldforce(forcefield f, vec3 pos, float t) {
+    vec3 delta = pos - f.posType.xyz;
+    float dist = length(delta), radius = f.params.x;
+    float falloff = radius > 0.0 ? max(0.0, 1.0 - dist / radius) : 1.0;
+    if (falloff == 0.0)
+        return vec3(0.0);
+
+    switch (int(f.posType.w)) {
+    case field_attractor:
+        return -f.dirStrength.w * falloff * delta / max(dist, 1e-3);
+    case field_vortex: {
+        vec3 radial = delta - f.dirStrength.xyz * dot(delta, f.dirStrength.xyz);
+        return f.dirStrength.w * falloff * cross(f.dirStrength.xyz, radial) / max(length(radial), 1e-3);
+    }
+    case field_gust:
+        return f.dirStrength.w * falloff * (0.5 + 0.5 * sin(f.params.y * t)) * f.dirStrength.xyz;
+    case field_repulsor:
+        return f.dirStrength.w * falloff * falloff * delta / max(dist, 1e-3);
+    }
+    return vec3(0.0);
+}
+
+vec3 accel(vec3 pos, vec3 vel, vec3 acc, float t) {
+    /* only fields binned into this particle's grid cell can reach it, then global ones */
+    ivec3 cell = clamp(ivec3(floor((pos - fieldgridmin) / (fieldgridmax - fieldgridmin) * vec3(fieldgridres))), ivec3(0), fieldgridres - 1);
+    uvec2 localCell = fieldCells[cell.x + fieldgridres.x * (cell.y + fieldgridres.y * cell.z)];
+    uvec2 globalCell = fieldCells[fieldgrid_ncells];
+    for (uint i = 0u; i < localCell.y; ++i)
+        acc += fieldforce(fields[fieldIndices[localCell.x + i]], pos, t);
+    for (uint i = 0u; i < globalCell.y; ++i)
+        acc += fieldforce(fields[fieldIndices[globalCell.x + i]], pos, t);
+    return acc;
+}
+
+void main() {
+    int instance = int(gl_GlobalInvocationID.x);
+    if (instance >= nparticles)
+        return;
+
+    /* each invocation only touches its own particle row, so update in place */
+    vec3 pos = vec3(pload(id_x), pload(id_y), pload(id_z));
+    vec3 vel = vec3(pload(id_vx), pload(id_vy), pload(id_vz));
+    vec3 acc = vec3(pload(id_ax), pload(id_ay), pload(id_az));
+    float dt = deltaTime;
+
+    for (int step = 0; step < nSteps; ++step) {
+        float t = time + float(step) * dt; /* gust phase advances with every substep */
+        if (pos.y < minY) {
+            pos = vec3(pload(id_initialx), pload(id_initialy), pload(id_initialz));
+            vel = vec3(pload(id_initialvx), pload(id_initialvy), pload(id_initialvz));
+            continue;
+        }
+
+#if integrator == integrator_semi
+        /* semi-implicit (symplectic) euler */
+        vel += accel(pos, vel, acc, t) * dt;
+        pos += vel * dt;
+#elif integrator == integrator_verlet
+        /* velocity verlet, end of step acceleration evaluated at predicted velocity */
+        vec3 a0 = accel(pos, vel, acc, t);
+        pos += vel * dt + 0.5 * a0 * dt * dt;
+        vec3 a1 = accel(pos, vel + a0 * dt, acc, t + dt);
+        vel += 0.5 * (a0 + a1) * dt;
+#elif integrator == integrator_rk2
+        /* midpoint runge-kutta */
+        vec3 a0 = accel(pos, vel, acc, t);
+        vec3 midvel = vel + 0.5 * a0 * dt;
+        vec3 a1 = accel(pos + 0.5 * vel * dt, midvel, acc, t + 0.5 * dt);
+        pos += midvel * dt;
+        vel += a1 * dt;
+#else
+        /* explicit euler */
+        vec3 a0 = accel(pos, vel, acc, t);
+        pos += vel * dt;
+        vel += a0 * dt;
+#endif
+    }
+
+    pstore(id_x, pos.x);
+    pstore(id_y, pos.y);
+    pstore(id_z, pos.z);
+    pstore(id_vx, vel.x);
+    pstore(id_vy, vel.y);
+    pstore(id_vz, vel.z);
+}
@@ -1 +0,0 @@
-void main() { }
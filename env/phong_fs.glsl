@@ -8,36 +8,166 @@
 
 #define GAMMA 2.2
 
+#define TEX_ARRAYS 8 /* texarray_maxbuckets */
+#define VTEX_MAX 2 /* vtex_max */
+#define VTEX_PAGE 128 /* vtex_pagesize */
+#define VTEX_BORDER 4 /* vtex_border */
+#define VTEX_ATLAS 4352 /* vtex_atlaspages * vtex_slotsize */
+
 in vec3 tngSpcFragPos;
 in vec3 tngSpcCamPos;
 in vec3 tngSpcLightPos;
 in vec2 uv_;
-layout (location = 5) uniform sampler2D texdiff;
-layout (location = 6) uniform sampler2D texnorm;
-layout (location = 7) uniform sampler2D texspec;
-layout (location = 8) uniform bool usetexdiff;
-layout (location = 9) uniform bool usetexnorm;
-layout (location = 10) uniform bool usetexspec;
+flat in uint drawid_;
+layout (location = 6) uniform sampler2DArray texarrays[TEX_ARRAYS];
+layout (location = 14) uniform bool texfeedbackenabled;
+#ifdef hasvtex /* permutation defines say which texture slots the batch's materials fill and whether any pages from tiles */
+layout (location = 15) uniform sampler2D vtexatlases[VTEX_MAX];
+layout (location = 17) uniform usampler2D vtexpages[VTEX_MAX];
+layout (location = 19) uniform ivec4 vtexinfo[VTEX_MAX]; /* width, height, levels, first feedback bit */
+#endif
+
+struct drawdata {
+    vec4 posoffset;
+    vec4 posscale;
+    ivec4 textures;
+};
+layout (std430, binding = 0) readonly buffer Draws {
+    drawdata draws[];
+};
+struct texentry {
+    int location; /* array in high 16 bits, layer in low 16 bits, -1 if not loaded, -2 - index for virtual textures */
+    int width; /* full resolution */
+    int height;
+    int minlevel; /* finest level uploaded to the layer */
+};
+layout (std430, binding = 1) readonly buffer Textures {
+    texentry texentries[]; /* shared by all scenes */
+};
+layout (std430, binding = 9) readonly buffer TextureRemap {
+    int texremap[]; /* scene texture id to shared id, -1 until acquired */
+};
+layout (std430, binding = 7) buffer Feedback {
+    uint texfeedback[]; /* finest level sampled per texture, cleared to ~0 after each readback */
+};
+#ifdef hasvtex
+layout (std430, binding = 8) buffer VirtualFeedback {
+    uint vtexrequests[]; /* one bit per page table texel, cleared after each readback */
+};
+#endif
+
 out vec4 color;
 
+int texshared(int id) {
+    return id < 0 ? -1 : texremap[id];
+}
+
+int texlocation(int id) {
+    return id < 0 ? -1 : texentries[id].location;
+}
+
+float texlod(int id, vec2 duvdx, vec2 duvdy) {
+    vec2 size = vec2(texentries[id].width, texentries[id].height);
+    return 0.5 * log2(max(dot(duvdx * size, duvdx * size), dot(duvdy * size, duvdy * size)));
+}
+
+void requesttex(int id, vec2 duvdx, vec2 duvdy) {
+    if (id < 0 || texentries[id].location < -1 || !texfeedbackenabled || ((int(gl_FragCoord.x) | int(gl_FragCoord.y)) & 3) != 0) /* one fragment in 16 reports */
+        return;
+    atomicMin(texfeedback[id], uint(max(0.0, floor(texlod(id, duvdx, duvdy)))));
+}
+
+vec4 sampletex(int location, float lod) {
+    vec3 coord = vec3(uv_, float(location & 0xffff));
+    switch (location >> 16) { /* constant indices only, arrays are picked per draw */
+    case 0: return textureLod(texarrays[0], coord, lod);
+    case 1: return textureLod(texarrays[1], coord, lod);
+    case 2: return textureLod(texarrays[2], coord, lod);
+    case 3: return textureLod(texarrays[3], coord, lod);
+    case 4: return textureLod(texarrays[4], coord, lod);
+    case 5: return textureLod(texarrays[5], coord, lod);
+    case 6: return textureLod(texarrays[6], coord, lod);
+    default: return textureLod(texarrays[7], coord, lod);
+    }
+}
+
+#ifdef hasvtex
+vec4 samplevtex(int v, vec2 duvdx, vec2 duvdy) {
+    /* level from the footprint at full resolution, then the page holding uv at that level */
+    ivec4 info = vtexinfo[v];
+    vec2 size = vec2(info.xy);
+    vec2 uv = clamp(uv_, 0.0, 1.0);
+    float lod = 0.5 * log2(max(dot(duvdx * size, duvdx * size), dot(duvdy * size, duvdy * size)));
+    int level = clamp(int(floor(lod)), 0, info.z - 1);
+    ivec2 levelsize = max(info.xy >> level, ivec2(1));
+    ivec2 page = min(ivec2(uv * vec2(levelsize)), levelsize - 1) / VTEX_PAGE;
+    uint entry = v == 0 ? texelFetch(vtexpages[0], page, level).r : texelFetch(vtexpages[1], page, level).r;
+
+    /* report the wanted page from one fragment in 16, bits follow the page table levels */
+    if (texfeedbackenabled && ((int(gl_FragCoord.x) | int(gl_FragCoord.y)) & 3) == 0) {
+        ivec2 tablesize = v == 0 ? textureSize(vtexpages[0], 0) : textureSize(vtexpages[1], 0);
+        int bit = info.w;
+        for (int l = 0; l < level; ++l)
+            bit += max(tablesize.x >> l, 1) * max(tablesize.y >> l, 1);
+        bit += page.y * max(tablesize.x >> level, 1) + page.x;
+        atomicOr(vtexrequests[bit >> 5], 1u << (bit & 31));
+    }
+    if ((entry >> 24) == 0u)
+        return vec4(0.5);
+
+    /* the page or its nearest resident ancestor, whose page index clamps to the pages of its level */
+    int mapped = int((entry >> 16) & 0xffu);
+    ivec2 mappedsize = max(info.xy >> mapped, ivec2(1));
+    ivec2 mappedpage = min(page >> (mapped - level), (mappedsize + VTEX_PAGE - 1) / VTEX_PAGE - 1);
+    vec2 inpage = clamp(uv * vec2(mappedsize) - vec2(mappedpage * VTEX_PAGE), vec2(0.5 - VTEX_BORDER), vec2(VTEX_PAGE + VTEX_BORDER - 0.5));
+    vec2 coord = (vec2(uvec2(entry & 0xffu, (entry >> 8) & 0xffu)) * float(VTEX_PAGE + 2 * VTEX_BORDER) + float(VTEX_BORDER) + inpage) / float(VTEX_ATLAS);
+    return v == 0 ? textureLod(vtexatlases[0], coord, 0.0) : textureLod(vtexatlases[1], coord, 0.0);
+}
+
+#endif
+
+vec4 sampleany(int id, vec2 duvdx, vec2 duvdy) {
+    int location = texentries[id].location;
+#ifdef hasvtex
+    if (location < -1)
+        return samplevtex(-2 - location, duvdx, duvdy);
+#endif
+    return sampletex(location, max(texlod(id, duvdx, duvdy), float(texentries[id].minlevel))); /* layers only hold levels from their min level down */
+}
+
 void main() {
-    vec3 diffColor;
-    if (usetexdiff)
-        diffColor = pow(texture(texdiff, uv_).rgb, vec3(GAMMA)); /* sRGB to linear RGB */
-    else
-        diffColor = DEFAULT_DIFF_COLOR;
-
-    vec3 tngSpcNorm;
-    if (usetexnorm)
-        tngSpcNorm = normalize(2.0 * texture(texnorm, uv_).xyz - 1.0);
-    else
-        tngSpcNorm = DEFAULT_TNG_SPC_NORM;
-
-    float specStrength;
-    if (usetexspec)
-        specStrength = texture(texspec, uv_).r;
-    else
-        specStrength = DEFAULT_SPEC_STRENGTH;
+    vec2 duvdx = dFdx(uv_);
+    vec2 duvdy = dFdy(uv_);
+
+    /* slots the materials leave empty compile out, filled ones still fall back while their texture loads */
+    vec3 diffColor = DEFAULT_DIFF_COLOR;
+#ifdef hastexdiff
+    int diffid = texshared(draws[drawid_].textures.x);
+    requesttex(diffid, duvdx, duvdy);
+    int texdiff = texlocation(diffid);
+    if (texdiff != -1)
+        diffColor = pow(sampleany(diffid, duvdx, duvdy).rgb, vec3(GAMMA)); /* sRGB to linear RGB */
+#endif
+
+    vec3 tngSpcNorm = DEFAULT_TNG_SPC_NORM;
+#ifdef hastexnorm
+    int normid = texshared(draws[drawid_].textures.y);
+    requesttex(normid, duvdx, duvdy);
+    int texnorm = texlocation(normid);
+    if (texnorm != -1) {
+        vec2 tngSpcNormXY = 2.0 * sampleany(normid, duvdx, duvdy).xy - 1.0; /* two channel (bc5) normal map, rebuild z */
+        tngSpcNorm = vec3(tngSpcNormXY, sqrt(max(0.0, 1.0 - dot(tngSpcNormXY, tngSpcNormXY))));
+    }
+#endif
+
+    float specStrength = DEFAULT_SPEC_STRENGTH;
+#ifdef hastexspec
+    int specid = texshared(draws[drawid_].textures.z);
+    requesttex(specid, duvdx, duvdy);
+    int texspec = texlocation(specid);
+    if (texspec != -1)
+        specStrength = sampleany(specid, duvdx, duvdy).r;
+#endif
 
     vec3 tngSpcCamDir = normalize(tngSpcCamPos - tngSpcFragPos);
     vec3 tngSpcLightDir = normalize(tngSpcLightPos - vec3(0.0)); /* directional light instead of point light */
@@ -3,27 +3,65 @@ layout (location = 1) in vec2 uv;
 layout (location = 2) in vec3 norm;
 layout (location = 3) in vec3 tng;
 layout (location = 4) in vec3 bitng;
-layout (location = 0) uniform mat4 projViewModel;
-layout (location = 1) uniform mat3 modelNormal;
-layout (location = 2) uniform mat4 model;
+layout (location = 5) in vec4 qtangent;
+layout (location = 6) in uint drawid;
+layout (location = 7) in uint node;
+layout (location = 0) uniform mat4 projView;
 layout (location = 3) uniform vec3 campos;
 layout (location = 4) uniform vec3 lightpos;
+
+struct drawdata {
+    vec4 posoffset;
+    vec4 posscale;
+    ivec4 textures;
+};
+layout (std430, binding = 0) readonly buffer Draws {
+    drawdata draws[];
+};
+
+struct nodedata {
+    mat4 world;
+    mat4 normal;
+};
+layout (std430, binding = 2) readonly buffer Nodes {
+    nodedata nodes[];
+};
+
 out vec3 tngSpcFragPos;
 out vec3 tngSpcCamPos;
 out vec3 tngSpcLightPos;
 out vec2 uv_;
+flat out uint drawid_;
 
 void main() {
-    vec3 worldNorm = normalize(modelNormal * norm);
-    vec3 worldTng = normalize(modelNormal * tng);
-    vec3 worldBitng = normalize(modelNormal * bitng);
+    vec3 meshPos = draws[drawid].posoffset.xyz + pos * draws[drawid].posscale.xyz;
+
+#ifdef packedvertex /* permutation define, the vertex format is fixed per batch */
+    vec4 q = normalize(qtangent);
+    vec3 frameTng = vec3(1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y + q.w * q.z), 2.0 * (q.x * q.z - q.w * q.y));
+    vec3 frameBitng = vec3(2.0 * (q.x * q.y - q.w * q.z), 1.0 - 2.0 * (q.x * q.x + q.z * q.z), 2.0 * (q.y * q.z + q.w * q.x)) * sign(qtangent.w);
+    vec3 frameNorm = vec3(2.0 * (q.x * q.z + q.w * q.y), 2.0 * (q.y * q.z - q.w * q.x), 1.0 - 2.0 * (q.x * q.x + q.y * q.y));
+#else
+    vec3 frameNorm = norm;
+    vec3 frameTng = tng;
+    vec3 frameBitng = bitng;
+#endif
+
+    mat4 world = nodes[node].world;
+    mat3 worldNormal = mat3(nodes[node].normal);
+
+    vec3 worldNorm = normalize(worldNormal * frameNorm);
+    vec3 worldTng = normalize(worldNormal * frameTng);
+    vec3 worldBitng = normalize(worldNormal * frameBitng);
     mat3 tngSpcMat = transpose(mat3(worldTng, worldBitng, worldNorm));
 
-    tngSpcFragPos = tngSpcMat * (model * vec4(pos, 1.0)).xyz;
+    vec4 worldPos = world * vec4(meshPos, 1.0);
+    tngSpcFragPos = tngSpcMat * worldPos.xyz;
     tngSpcCamPos = tngSpcMat * campos;
     tngSpcLightPos = tngSpcMat * lightpos;
 
     uv_ = uv;
+    drawid_ = drawid;
 
-    gl_Position = projViewModel * vec4(pos, 1.0);
+    gl_Position = projView * worldPos;
 }
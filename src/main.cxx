@@ -8,20 +8,44 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/mat4x4.hpp>
+#include <glm/gtc/packing.hpp>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <initializer_list>
 #include <iostream>
 #include <vector>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 #include <string>
 #include <cstddef>
 #include <cassert>
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
 #include <ctime>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 #define VERSION_STRING "#version 430 core"
 
@@ -31,35 +55,149 @@ static glm::vec3 cameracenter(0.0f);
 static glm::vec3 camerapos(0.0f, 3.0f, 10.0f);
 static glm::vec3 lightpos(5.0f, 5.0f, -5.0f);
 static double xprev = 0.0, yprev = 0.0;
-static GLuint phong_prog = 0;
-#define phong_projViewModel_uniform 0
-#define phong_modelNormal_uniform 1
-#define phong_model_uniform 2
+static std::string snapshotloadpath, snapshotsavepath;
+static int prewarmsteps = 0;
+static std::string recordpath, playbackpath;
+#define integrator_euler 0
+#define integrator_semi 1
+#define integrator_verlet 2
+#define integrator_rk2 3
+static int integrator = integrator_euler;
+static float timestep = 0.0f;
+static std::string fieldspath;
+static glm::vec3 cursorpos(0.0f);
+static bool cursoractive = false, cursormoved = false;
+static bool s3tcsupported = false;
+static bool uploadthread = false;
+static bool packvertices = false;
+static bool keephierarchy = false;
+static bool virtualterrain = false;
+static std::size_t texbudget = static_cast<std::size_t>(256) << 20;
+static std::string packpath, packsourcedir;
+#define phong_projView_uniform 0
 #define phong_campos_uniform 3
 #define phong_lightpos_uniform 4
-#define phong_texdiff_uniform 5
-#define phong_texnorm_uniform 6
-#define phong_texspec_uniform 7
-#define phong_usetexdiff_uniform 8
-#define phong_usetexnorm_uniform 9
-#define phong_usetexspec_uniform 10
+#define phong_texarrays_uniform 6
+#define phong_draws_binding 0
+#define phong_textable_binding 1
+#define phong_drawid_attrib 6
+#define phong_node_attrib 7
+#define phong_nodes_binding 2
+#define phong_texfeedback_uniform 14
+#define phong_feedback_binding 7
+#define phong_vtexatlases_uniform 15
+#define phong_vtexpages_uniform 17
+#define phong_vtexinfo_uniform 19
+#define phong_vtexrequests_binding 8
+#define phong_texremap_binding 9
+static GLuint cluster_prog = 0;
+#define cluster_planes_uniform 0
+#define cluster_campos_uniform 6
+#define cluster_clusters_binding 3
+#define cluster_jobs_binding 4
+#define cluster_commands_binding 5
+#define cluster_instances_binding 6
+#define cluster_local_size 64
+
+/* read-only memory mapped file, or a view into the asset pack that stays mapped */
+typedef struct {
+    const unsigned char* data;
+    std::size_t size;
+    bool view;
+} mappedfile;
+
+/* asset pack, an index of names sorted for lookup followed by aligned blobs, mapped once */
+#define pack_magic 0x4b504152u /* "RAPK" */
+#define pack_version 1u
+#define pack_align 64
+typedef struct __attribute__((packed)) {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t nentries;
+    std::uint32_t reserved;
+} packheader;
 
-static GLuint compileshaderdefs(GLenum shadertype, const std::string& sourcepath, const std::unordered_map<std::string, std::string>& defs, const std::string& verstr = VERSION_STRING) {
+/* pack index entry, names follow the entries */
+typedef struct __attribute__((packed)) {
+    std::uint64_t offset;       /* from start of pack */
+    std::uint64_t size;
+    std::uint32_t nameoffset;   /* from start of names */
+    std::uint32_t namelen;
+} packentry;
+
+static mappedfile assetpack = { nullptr, 0, false };
+static const packentry* packentries = nullptr;
+static const char* packnames = nullptr;
+static std::uint32_t npackentries = 0;
+
+static bool findasset(const std::string& filepath, mappedfile& mf) {
+
+    /* binary search sorted names, relative paths name assets */
+    std::string name = filepath.compare(0, 2, "./") == 0 ? filepath.substr(2) : filepath;
+    const packentry* it = std::lower_bound(packentries, packentries + npackentries, name, [](const packentry& e, const std::string& n) {
+        return n.compare(0, std::string::npos, packnames + e.nameoffset, e.namelen) > 0;
+    });
+    if (it == packentries + npackentries || name.compare(0, std::string::npos, packnames + it->nameoffset, it->namelen) != 0)
+        return false;
+
+    /* hand out view */
+    mf.data = assetpack.data + it->offset;
+    mf.size = static_cast<std::size_t>(it->size);
+    mf.view = true;
+    return true;
+
+}
+
+static bool mapfile(const std::string& filepath, mappedfile& mf) {
+
+    /* assets in the pack need no syscalls */
+    mf.data = nullptr;
+    mf.size = 0;
+    mf.view = false;
+    if (npackentries > 0 && findasset(filepath, mf))
+        return true;
+
+    /* open file and tell its size */
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
 
-    /* open source file stream */
-    std::ifstream sourcestream(sourcepath, std::ios::in | std::ios::binary);
-    assert(sourcestream.good());
+    /* map whole file, the mapping outlives the descriptor */
+    void* addr = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return false;
 
-    /* tell source file length */
-    sourcestream.seekg(0, std::ios::end);
-    GLint sourcelen = static_cast<GLint>(sourcestream.tellg());
-    sourcestream.seekg(0, std::ios::beg);
+    /* return mapping */
+    mf.data = static_cast<const unsigned char*>(addr);
+    mf.size = static_cast<std::size_t>(st.st_size);
+    return true;
+
+}
+
+static void unmapfile(mappedfile& mf) {
+
+    /* unmap and reset, pack views stay */
+    if (mf.data != nullptr && !mf.view)
+        munmap(const_cast<unsigned char*>(mf.data), mf.size);
+    mf.data = nullptr;
+    mf.size = 0;
+    mf.view = false;
+
+}
+
+static GLuint compileshaderdefs(GLenum shadertype, const std::string& sourcepath, const std::unordered_map<std::string, std::string>& defs, const std::string& verstr = VERSION_STRING) {
 
-    /* read and close stream */
-    std::vector<GLchar> source;
-    source.reserve(static_cast<std::size_t>(sourcelen));
-    sourcestream.read(reinterpret_cast<char*>(source.data()), static_cast<std::streamsize>(sourcelen));
-    sourcestream.close();
+    /* map source, straight from the asset pack if it holds it */
+    mappedfile source;
+    bool mapped = mapfile(sourcepath, source);
+    assert(mapped);
+    GLint sourcelen = static_cast<GLint>(source.size);
 
     /* create shader and prepare buffers */
     GLuint shader = glCreateShader(shadertype);
@@ -72,13 +210,14 @@ static GLuint compileshaderdefs(GLenum shadertype, const std::string& sourcepath
     std::string defsrc = ss_defsrc.str();
     const GLchar* defsrcbuffer = reinterpret_cast<const GLchar*>(defsrc.c_str());
     GLint defsrcbufflen = defsrc.size();
-    const GLchar* sourcebuffer = source.data();
+    const GLchar* sourcebuffer = reinterpret_cast<const GLchar*>(source.data);
 
     /* load and compile shader */
     const GLchar* buffers[] = { verbuffer, defsrcbuffer, sourcebuffer };
     GLint bufflens[] = { verbufflen, defsrcbufflen, sourcelen };
     #define nbuffers (sizeof(buffers) / sizeof(*buffers))
     glShaderSource(shader, nbuffers, buffers, bufflens);
+    unmapfile(source);
     glCompileShader(shader);
 
     /* assure successful shader compilation */
@@ -99,20 +238,13 @@ static GLuint compileshaderdefs(GLenum shadertype, const std::string& sourcepath
 
 }
 
-static GLuint compileshader(GLenum shadertype, const std::string& sourcepath, const std::string& verstr = VERSION_STRING) {
-
-    /* create empty defines map and compile shader with it */
-    std::unordered_map<std::string, std::string> defs;
-    return compileshaderdefs(shadertype, sourcepath, defs, verstr);
-
-}
-
-static GLuint linkprogram(const std::initializer_list<GLuint>& shaders) {
+static GLuint linkprogram(const std::vector<GLuint>& shaders) {
 
     /* create program and attach shaders, then link */
     GLuint program = glCreateProgram();
     for (GLuint shader : shaders)
         glAttachShader(program, shader);
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
 
     /* assure successful program linkage */
@@ -133,323 +265,4560 @@ static GLuint linkprogram(const std::initializer_list<GLuint>& shaders) {
 
 }
 
-static GLuint loadtex(const std::string& imgpath) {
+static std::uint64_t hashbytes(const unsigned char* data, std::size_t size, std::uint64_t hash = 0xcbf29ce484222325ull) {
 
-    /* ask stb_image to flip on y axis */
-    stbi_set_flip_vertically_on_load(true);
+    /* 64-bit fnv-1a */
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
 
-    /* load image */
-    int x, y, nc;
-    unsigned char* data = stbi_load(imgpath.c_str(), &x, &y, &nc, 4);
-    assert(data != nullptr);
+}
+
+static bool openpack(const std::string& packpath) {
+
+    /* map pack and validate header */
+    if (!mapfile(packpath, assetpack))
+        return false;
+    const packheader* header = reinterpret_cast<const packheader*>(assetpack.data);
+    if (assetpack.size < sizeof(packheader) || header->magic != pack_magic || header->version != pack_version || assetpack.size < sizeof(packheader) + static_cast<std::size_t>(header->nentries) * sizeof(packentry)) {
+        unmapfile(assetpack);
+        return false;
+    }
+
+    /* every name and blob must lie within the pack */
+    const packentry* entries = reinterpret_cast<const packentry*>(assetpack.data + sizeof(packheader));
+    const char* names = reinterpret_cast<const char*>(entries + header->nentries);
+    std::size_t szindex = sizeof(packheader) + header->nentries * sizeof(packentry);
+    for (std::uint32_t i = 0; i < header->nentries; ++i)
+        if (szindex + entries[i].nameoffset + entries[i].namelen > assetpack.size || entries[i].offset + entries[i].size > assetpack.size) {
+            unmapfile(assetpack);
+            return false;
+        }
+    packentries = entries;
+    packnames = names;
+    npackentries = header->nentries;
+    return true;
+
+}
+
+static void listassets(const std::string& directory, const std::string& prefix, std::vector<std::string>& names) {
+
+    /* regular files below directory, named relative to it */
+    DIR* dir = opendir((directory + "/" + prefix).c_str());
+    if (dir == nullptr)
+        return;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = prefix + entry->d_name;
+        struct stat st;
+        if (entry->d_name[0] == '.' || stat((directory + "/" + name).c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            listassets(directory, name + "/", names);
+        else if (S_ISREG(st.st_mode))
+            names.push_back(name);
+    }
+    closedir(dir);
+
+}
+
+static bool buildpack(const std::string& directory, const std::string& packpath) {
+
+    /* collect assets, leaving out caches, tiles cut from images next to them and other packs */
+    std::vector<std::string> listed, names;
+    listassets(directory, "", listed);
+    for (const std::string& name : listed) {
+        std::string ext = name.substr(name.find_last_of('.') == std::string::npos ? name.size() : name.find_last_of('.'));
+        struct stat st;
+        if (ext == ".meshcache" || ext == ".texcache" || ext == ".progcache" || ext == ".pack" || (ext == ".vtex" && stat((directory + "/" + name.substr(0, name.size() - 5)).c_str(), &st) == 0))
+            continue;
+        names.push_back(name);
+    }
+    std::sort(names.begin(), names.end());
+
+    /* open stream */
+    std::ofstream stream(packpath, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!stream.good())
+        return false;
+
+    /* index first, blobs start aligned after it */
+    std::vector<mappedfile> files(names.size());
+    std::vector<packentry> entries(names.size());
+    std::string nametable;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        if (!mapfile(directory + "/" + names[i], files[i]))
+            files[i].size = 0;
+        entries[i].nameoffset = static_cast<std::uint32_t>(nametable.size());
+        entries[i].namelen = static_cast<std::uint32_t>(names[i].size());
+        nametable += names[i];
+    }
+    std::uint64_t offset = sizeof(packheader) + names.size() * sizeof(packentry) + nametable.size();
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        offset = (offset + pack_align - 1) / pack_align * pack_align;
+        entries[i].offset = offset;
+        entries[i].size = files[i].size;
+        offset += files[i].size;
+    }
+
+    /* write header, index and names, then padded blobs */
+    packheader header = { pack_magic, pack_version, static_cast<std::uint32_t>(names.size()), 0 };
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(packentry)));
+    stream.write(nametable.data(), static_cast<std::streamsize>(nametable.size()));
+    static const char padding[pack_align] = { 0 };
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        stream.write(padding, static_cast<std::streamsize>(entries[i].offset - static_cast<std::uint64_t>(stream.tellp())));
+        if (files[i].data != nullptr)
+            stream.write(reinterpret_cast<const char*>(files[i].data), static_cast<std::streamsize>(files[i].size));
+        unmapfile(files[i]);
+    }
+    stream.close();
+    return stream.good();
+
+}
+
+static bool hashfile(const std::string& filepath, std::uint64_t& hash) {
+
+    /* hash mapped contents */
+    mappedfile mf;
+    if (!mapfile(filepath, mf))
+        return false;
+    hash = hashbytes(mf.data, mf.size);
+    unmapfile(mf);
+    return true;
+
+}
+
+/* program cache file header, followed by the driver's program binary */
+#define progcache_magic 0x42505241u /* "RAPB" */
+#define progcache_version 1u
+typedef struct __attribute__((packed)) {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t hash;
+    std::uint32_t format;
+    std::uint32_t size;
+} progcacheheader;
+
+/* one shader stage of a program, compiled from source only when the cache misses */
+typedef struct {
+    GLenum type;
+    std::string path;
+    std::unordered_map<std::string, std::string> defs;
+} programstage;
+
+static std::uint64_t hashprogram(const std::initializer_list<programstage>& stages, const std::string& verstr, std::uint64_t& defshash) {
+
+    /* driver strings, binaries only load back into the driver that wrote them */
+    std::uint64_t hash = hashbytes(reinterpret_cast<const unsigned char*>(verstr.data()), verstr.size());
+    const GLenum driverstrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (GLenum name : driverstrings) {
+        const GLubyte* str = glGetString(name);
+        if (str != nullptr)
+            hash = hashbytes(str, std::strlen(reinterpret_cast<const char*>(str)) + 1, hash);
+    }
+
+    /* stage types, sources and defines in name order, map order is unspecified */
+    defshash = hashbytes(nullptr, 0);
+    for (const programstage& stage : stages) {
+        hash = hashbytes(reinterpret_cast<const unsigned char*>(&stage.type), sizeof(stage.type), hash);
+        std::uint64_t sourcehash = 0;
+        bool hashed = hashfile(stage.path, sourcehash);
+        assert(hashed);
+        hash = hashbytes(reinterpret_cast<const unsigned char*>(&sourcehash), sizeof(sourcehash), hash);
+        std::vector<std::pair<std::string, std::string>> sorted(stage.defs.begin(), stage.defs.end());
+        std::sort(sorted.begin(), sorted.end());
+        for (const std::pair<std::string, std::string>& def : sorted) {
+            std::string line = def.first + " " + def.second + "\n";
+            defshash = hashbytes(reinterpret_cast<const unsigned char*>(line.data()), line.size(), defshash);
+        }
+        defshash = hashbytes(reinterpret_cast<const unsigned char*>("\n"), 1, defshash);
+    }
+    return hashbytes(reinterpret_cast<const unsigned char*>(&defshash), sizeof(defshash), hash);
+
+}
+
+static GLuint buildprogram(const std::initializer_list<programstage>& stages, const std::string& verstr = VERSION_STRING) {
+
+    /* caches sit next to the first source, one per set of defines */
+    std::uint64_t defshash;
+    std::uint64_t hash = hashprogram(stages, verstr, defshash);
+    std::stringstream ss_cachepath;
+    ss_cachepath << stages.begin()->path << "." << std::hex << std::setw(8) << std::setfill('0') << static_cast<std::uint32_t>(defshash) << ".progcache";
+    std::string cachepath = ss_cachepath.str();
+
+    /* restore binary when the key matches, drivers may still refuse it */
+    GLint nformats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nformats);
+    mappedfile cache;
+    if (nformats > 0 && mapfile(cachepath, cache)) {
+        const progcacheheader* header = reinterpret_cast<const progcacheheader*>(cache.data);
+        if (cache.size >= sizeof(progcacheheader) && header->magic == progcache_magic && header->version == progcache_version && header->hash == hash
+            && cache.size >= sizeof(progcacheheader) + header->size) {
+            GLuint program = glCreateProgram();
+            glProgramBinary(program, header->format, cache.data + sizeof(progcacheheader), static_cast<GLsizei>(header->size));
+            GLint status;
+            glGetProgramiv(program, GL_LINK_STATUS, &status);
+            if (status == GL_TRUE) {
+                unmapfile(cache);
+                return program;
+            }
+            glDeleteProgram(program);
+        }
+        unmapfile(cache);
+    }
+
+    /* compile and link, shaders are not needed once linked */
+    std::vector<GLuint> shaders;
+    for (const programstage& stage : stages)
+        shaders.push_back(compileshaderdefs(stage.type, stage.path, stage.defs, verstr));
+    GLuint program = linkprogram(shaders);
+    for (GLuint shader : shaders) {
+        glDetachShader(program, shader);
+        glDeleteShader(shader);
+    }
+
+    /* fetch binary, drivers without binary formats go without cache */
+    GLint binarylen = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binarylen);
+    if (nformats <= 0 || binarylen <= 0)
+        return program;
+    std::vector<unsigned char> binary(static_cast<std::size_t>(binarylen));
+    GLenum format = 0;
+    glGetProgramBinary(program, binarylen, nullptr, &format, binary.data());
+
+    /* write cache, quietly leaving it out if it cannot be written */
+    std::ofstream stream(cachepath, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!stream.good()) {
+        std::cerr << "cannot write program cache " << cachepath << std::endl;
+        return program;
+    }
+    progcacheheader header = { progcache_magic, progcache_version, hash, format, static_cast<std::uint32_t>(binary.size()) };
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(binary.data()), static_cast<std::streamsize>(binary.size()));
+    stream.close();
+    return program;
+
+}
+
+/* worker pool running cpu side loading jobs */
+static std::vector<std::thread> workers;
+static std::deque<std::function<void()>> jobs;
+static std::mutex jobsmutex;
+static std::condition_variable jobscv;
+static bool workersquit = false;
+
+/* gl work handed back from workers, upload may run on the loader context, finish needs the render context */
+typedef struct {
+    std::function<void()> upload;
+    std::function<void()> finish;
+} pendingupload;
+static std::deque<pendingupload> uploads;
+static std::mutex uploadsmutex;
+static std::condition_variable uploadscv;
+
+/* optional loader thread owning a hidden context that shares objects with the window */
+static GLFWwindow* loaderwindow = nullptr;
+static std::thread loader;
+static bool loaderquit = false;
+
+/* loader uploads waiting on their fence before the render thread finishes them */
+typedef struct {
+    GLsync fence;
+    std::function<void()> finish;
+} fencedupload;
+static std::deque<fencedupload> fenced;
+static std::mutex fencedmutex;
+
+static void startworkers() {
+
+    /* leave one core to the render thread */
+    int nworkers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    for (int i = 0; i < nworkers; ++i)
+        workers.emplace_back([]() {
+            for (;;) {
+                std::unique_lock<std::mutex> lock(jobsmutex);
+                jobscv.wait(lock, [] { return workersquit || !jobs.empty(); });
+                if (workersquit)
+                    return;
+                std::function<void()> job = std::move(jobs.front());
+                jobs.pop_front();
+                lock.unlock();
+                job();
+            }
+        });
+
+}
+
+static void stopworkers() {
+
+    /* drop queued jobs and join */
+    {
+        std::lock_guard<std::mutex> lock(jobsmutex);
+        workersquit = true;
+        jobs.clear();
+    }
+    jobscv.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+
+}
+
+static void submitjob(std::function<void()> job) {
+
+    /* queue job for first free worker */
+    std::lock_guard<std::mutex> lock(jobsmutex);
+    jobs.push_back(std::move(job));
+    jobscv.notify_one();
+
+}
+
+static void startloader() {
+
+    /* loader thread takes over the shared context */
+    loader = std::thread([]() {
+        glfwMakeContextCurrent(loaderwindow);
+        for (;;) {
+            std::unique_lock<std::mutex> lock(uploadsmutex);
+            uploadscv.wait(lock, [] { return loaderquit || !uploads.empty(); });
+            if (loaderquit)
+                break;
+            pendingupload item = std::move(uploads.front());
+            uploads.pop_front();
+            lock.unlock();
+            item.upload();
+
+            /* fence and flush, so that the render context can test it */
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+            std::lock_guard<std::mutex> fencedlock(fencedmutex);
+            fenced.push_back({ fence, std::move(item.finish) });
+        }
+        glfwMakeContextCurrent(nullptr);
+    });
+
+}
+
+static void stoploader() {
+
+    /* drop queued uploads and join */
+    {
+        std::lock_guard<std::mutex> lock(uploadsmutex);
+        loaderquit = true;
+        uploads.clear();
+    }
+    uploadscv.notify_all();
+    loader.join();
+
+    /* delete fences never finished, sync objects are shared */
+    for (fencedupload& item : fenced)
+        glDeleteSync(item.fence);
+    fenced.clear();
+
+}
+
+static void submitupload(std::function<void()> upload, std::function<void()> finish = nullptr) {
+
+    /* queue gl work for loader or render thread */
+    std::lock_guard<std::mutex> lock(uploadsmutex);
+    uploads.push_back({ std::move(upload), std::move(finish) });
+    uploadscv.notify_one();
+
+}
+
+static void drainuploads(double budget) {
+
+    /* finish loader uploads in order, once the gpu is done with them, until time budget is spent, at least one item per call */
+    double start = glfwGetTime();
+    for (;;) {
+        std::unique_lock<std::mutex> lock(fencedmutex);
+        if (fenced.empty())
+            break;
+        GLenum status = glClientWaitSync(fenced.front().fence, 0, 0);
+        assert(status != GL_WAIT_FAILED);
+        if (status == GL_TIMEOUT_EXPIRED)
+            break;
+        fencedupload item = std::move(fenced.front());
+        fenced.pop_front();
+        lock.unlock();
+        glDeleteSync(item.fence);
+        if (item.finish)
+            item.finish();
+        if (glfwGetTime() - start >= budget)
+            return;
+    }
+
+    /* without loader run queued gl work here until time budget is spent, at least one item per call */
+    if (loaderwindow != nullptr)
+        return;
+    do {
+        std::unique_lock<std::mutex> lock(uploadsmutex);
+        if (uploads.empty())
+            return;
+        pendingupload item = std::move(uploads.front());
+        uploads.pop_front();
+        lock.unlock();
+        item.upload();
+        if (item.finish)
+            item.finish();
+    } while (glfwGetTime() - start < budget);
+
+}
+
+/* s3tc formats are not core, glad was generated without extensions */
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+/* texture kinds, normal maps only keep x and y */
+#define texkind_color 0
+#define texkind_normal 1
+
+/* texture cache file header, followed by level table and block compressed levels */
+#define texcache_magic 0x43544152u /* "RATC" */
+#define texcache_version 2u
+#define texcache_maxlevels 16
+typedef struct __attribute__((packed)) {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t hash;
+    std::uint32_t kind;
+    std::uint32_t format;
+    std::uint32_t nlevels;
+} texcacheheader;
+
+typedef struct __attribute__((packed)) {
+    std::uint64_t offset;
+    std::uint32_t width, height;
+    std::uint32_t size;
+    std::uint32_t reserved;
+} texcachelevel;
+
+static void encodebc4block(const unsigned char* values, int stride, unsigned char* out) {
+
+    /* endpoints are block extremes, always using the 8 value mode (r0 > r1) */
+    unsigned char lo = 255, hi = 0;
+    for (int i = 0; i < 16; ++i) {
+        lo = std::min(lo, values[i * stride]);
+        hi = std::max(hi, values[i * stride]);
+    }
+    out[0] = hi;
+    out[1] = lo;
+
+    /* pick nearest of the 8 interpolated values, index 0 is r0, 1 is r1, 2 to 7 run from r0 to r1 */
+    std::uint64_t bits = 0;
+    if (hi > lo)
+        for (int i = 0; i < 16; ++i) {
+            int pos = ((hi - values[i * stride]) * 7 + (hi - lo) / 2) / (hi - lo);
+            std::uint64_t index = pos == 0 ? 0 : pos == 7 ? 1 : pos + 1;
+            bits |= index << (3 * i);
+        }
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = static_cast<unsigned char>(bits >> (8 * i));
+
+}
+
+static void encodebc1block(const unsigned char* rgba, unsigned char* out) {
+
+    /* find principal axis of block colors by power iteration on their covariance */
+    float mean[3] = { 0.0f, 0.0f, 0.0f }, cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += rgba[4 * i + c] / 16.0f;
+    for (int i = 0; i < 16; ++i) {
+        float r = rgba[4 * i] - mean[0], g = rgba[4 * i + 1] - mean[1], b = rgba[4 * i + 2] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iter = 0; iter < 4; ++iter) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float len = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+        if (len == 0.0f)
+            break;
+        axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+    }
+
+    /* endpoints are the colors projecting furthest along that axis */
+    int imin = 0, imax = 0;
+    float pmin = 1e30f, pmax = -1e30f;
+    for (int i = 0; i < 16; ++i) {
+        float p = rgba[4 * i] * axis[0] + rgba[4 * i + 1] * axis[1] + rgba[4 * i + 2] * axis[2];
+        if (p < pmin) { pmin = p; imin = i; }
+        if (p > pmax) { pmax = p; imax = i; }
+    }
+    #define to565(c) static_cast<std::uint16_t>(((c)[0] >> 3) << 11 | ((c)[1] >> 2) << 5 | ((c)[2] >> 3))
+    std::uint16_t c0 = to565(rgba + 4 * imax), c1 = to565(rgba + 4 * imin);
+    if (c0 < c1)
+        std::swap(c0, c1);
+    out[0] = static_cast<unsigned char>(c0);
+    out[1] = static_cast<unsigned char>(c0 >> 8);
+    out[2] = static_cast<unsigned char>(c1);
+    out[3] = static_cast<unsigned char>(c1 >> 8);
+
+    /* build 4 color palette (c0 > c1 mode) from quantized endpoints */
+    int palette[4][3];
+    for (int k = 0; k < 2; ++k) {
+        std::uint16_t c = k == 0 ? c0 : c1;
+        palette[k][0] = (c >> 11 & 31) * 255 / 31;
+        palette[k][1] = (c >> 5 & 63) * 255 / 63;
+        palette[k][2] = (c & 31) * 255 / 31;
+    }
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    /* pick nearest palette entry per texel */
+    std::uint32_t bits = 0;
+    if (c0 != c1)
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestdist = 1 << 30;
+            for (int k = 0; k < 4; ++k) {
+                int dr = rgba[4 * i] - palette[k][0], dg = rgba[4 * i + 1] - palette[k][1], db = rgba[4 * i + 2] - palette[k][2];
+                int dist = dr * dr + dg * dg + db * db;
+                if (dist < bestdist) {
+                    bestdist = dist;
+                    best = k;
+                }
+            }
+            bits |= static_cast<std::uint32_t>(best) << (2 * i);
+        }
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = static_cast<unsigned char>(bits >> (8 * i));
+
+}
+
+static std::size_t texblocksize(GLenum format) {
+
+    /* bc1 uses 8 bytes per 4x4 block, bc3 and bc5 16 bytes */
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+
+}
+
+static void encodetexlevel(const unsigned char* rgba, int w, int h, GLenum format, std::vector<unsigned char>& out) {
+
+    /* allocate blocks, partial blocks are padded by clamping */
+    int bw = (w + 3) / 4, bh = (h + 3) / 4;
+    std::size_t szblock = texblocksize(format);
+    out.resize(static_cast<std::size_t>(bw) * bh * szblock);
+
+    /* encode block rows in parallel */
+    auto encoderows = [&](int rowbegin, int rowend) {
+        unsigned char block[64];
+        for (int by = rowbegin; by < rowend; ++by)
+            for (int bx = 0; bx < bw; ++bx) {
+                for (int i = 0; i < 16; ++i) {
+                    int x = std::min(4 * bx + i % 4, w - 1), y = std::min(4 * by + i / 4, h - 1);
+                    std::memcpy(block + 4 * i, rgba + 4 * (static_cast<std::size_t>(y) * w + x), 4);
+                }
+                unsigned char* dst = out.data() + (static_cast<std::size_t>(by) * bw + bx) * szblock;
+                if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+                    encodebc1block(block, dst);
+                else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+                    encodebc4block(block + 3, 4, dst);
+                    encodebc1block(block, dst + 8);
+                } else {
+                    encodebc4block(block, 4, dst);
+                    encodebc4block(block + 1, 4, dst + 8);
+                }
+            }
+    };
+    int nthreads = std::max(1, std::min(static_cast<int>(std::thread::hardware_concurrency()), bh / 8));
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nthreads; ++t)
+        threads.emplace_back(encoderows, bh * t / nthreads, bh * (t + 1) / nthreads);
+    encoderows(0, bh / nthreads);
+    for (std::thread& thread : threads)
+        thread.join();
+
+}
+
+static void downsampletex(const std::vector<unsigned char>& src, int w, int h, std::vector<unsigned char>& dst) {
+
+    /* 2x2 box filter, odd edges reuse their last texel */
+    int dw = std::max(1, w / 2), dh = std::max(1, h / 2);
+    dst.resize(static_cast<std::size_t>(dw) * dh * 4);
+    for (int y = 0; y < dh; ++y)
+        for (int x = 0; x < dw; ++x) {
+            int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1), y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+            for (int c = 0; c < 4; ++c)
+                dst[4 * (static_cast<std::size_t>(y) * dw + x) + c] = static_cast<unsigned char>((src[4 * (y0 * w + x0) + c] + src[4 * (y0 * w + x1) + c] + src[4 * (y1 * w + x0) + c] + src[4 * (y1 * w + x1) + c] + 2) / 4);
+        }
+
+}
+
+static void encodetexchain(const unsigned char* rgba, int w, int h, GLenum format, std::vector<texcachelevel>& table, std::vector<unsigned char>& blob) {
+
+    /* encode full mip chain into one blob, level offsets are relative to its start */
+    std::vector<unsigned char> current(rgba, rgba + static_cast<std::size_t>(w) * h * 4), next, encoded;
+    for (;;) {
+        encodetexlevel(current.data(), w, h, format, encoded);
+        texcachelevel level = { blob.size(), static_cast<std::uint32_t>(w), static_cast<std::uint32_t>(h), static_cast<std::uint32_t>(encoded.size()), 0 };
+        table.push_back(level);
+        blob.insert(blob.end(), encoded.begin(), encoded.end());
+        if ((w == 1 && h == 1) || table.size() == texcache_maxlevels)
+            break;
+        downsampletex(current, w, h, next);
+        current.swap(next);
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+
+}
+
+static void writetexcache(const std::string& cachepath, std::uint64_t hash, int kind, GLenum format, const std::vector<texcachelevel>& table, const std::vector<unsigned char>& blob) {
+
+    /* open stream, quietly leaving the cache out if it cannot be written */
+    std::ofstream stream(cachepath, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!stream.good()) {
+        std::cerr << "cannot write texture cache " << cachepath << std::endl;
+        return;
+    }
+
+    /* write header, level table and blob */
+    texcacheheader header = { texcache_magic, texcache_version, hash, static_cast<std::uint32_t>(kind), format, static_cast<std::uint32_t>(table.size()) };
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(table.size() * sizeof(texcachelevel)));
+    stream.write(reinterpret_cast<const char*>(blob.data()), static_cast<std::streamsize>(blob.size()));
+    stream.close();
+
+}
+
+/* texture prepared for upload off the render thread */
+typedef struct {
+    mappedfile cache;
+    GLenum format;                          /* block compressed format, or GL_RGBA8 when uncompressed */
+    std::vector<texcachelevel> levels;
+    std::vector<unsigned char> blob;        /* encoded levels or raw rgba when not backed by cache */
+    const unsigned char* data;              /* start of levels, into cache mapping or blob */
+} preparedtex;
+
+static bool loadtexcache(const std::string& cachepath, std::uint64_t hash, int kind, preparedtex& pt) {
+
+    /* map cache and validate its key, any kind matches if kind is negative */
+    if (!mapfile(cachepath, pt.cache))
+        return false;
+    const texcacheheader* header = reinterpret_cast<const texcacheheader*>(pt.cache.data);
+    if (pt.cache.size < sizeof(texcacheheader) || header->magic != texcache_magic || header->version != texcache_version || header->hash != hash || (kind >= 0 && header->kind != static_cast<std::uint32_t>(kind))
+        || header->nlevels == 0 || header->nlevels > texcache_maxlevels || pt.cache.size < sizeof(texcacheheader) + header->nlevels * sizeof(texcachelevel)) {
+        unmapfile(pt.cache);
+        return false;
+    }
+
+    /* level table and blob follow header */
+    const texcachelevel* table = reinterpret_cast<const texcachelevel*>(pt.cache.data + sizeof(texcacheheader));
+    pt.data = reinterpret_cast<const unsigned char*>(table + header->nlevels);
+    if (pt.data + table[header->nlevels - 1].offset + table[header->nlevels - 1].size > pt.cache.data + pt.cache.size) {
+        unmapfile(pt.cache);
+        return false;
+    }
+    pt.format = header->format;
+    pt.levels.assign(table, table + header->nlevels);
+    return true;
+
+}
+
+static void preparetex(const std::string& imgpath, std::uint64_t hash, std::shared_future<int> kind, preparedtex& pt) {
+
+    /* map source image, its cache is keyed by the hash of its contents */
+    pt.cache.data = nullptr;
+    mappedfile source;
+    bool mapped = mapfile(imgpath, source);
+    assert(mapped);
+    std::string cachepath = imgpath + ".texcache";
+
+    /* while kind is still unknown, decode right away unless a cache will serve it anyway */
+    int x = 0, y = 0, nc;
+    unsigned char* data = nullptr;
+    if (kind.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        if (loadtexcache(cachepath, hash, -1, pt)) {
+            unmapfile(pt.cache);
+            pt.levels.clear();
+        } else {
+            data = stbi_load_from_memory(source.data, static_cast<int>(source.size), &x, &y, &nc, 4);
+            assert(data != nullptr);
+        }
+    }
+
+    /* use cached levels if present */
+    if (loadtexcache(cachepath, hash, kind.get(), pt)) {
+        unmapfile(source);
+        if (data != nullptr)
+            stbi_image_free(data);
+        return;
+    }
+
+    /* load image, then drop source mapping */
+    if (data == nullptr) {
+        data = stbi_load_from_memory(source.data, static_cast<int>(source.size), &x, &y, &nc, 4);
+        assert(data != nullptr);
+    }
+    unmapfile(source);
+
+    /* block compress to bc5 for normal maps, otherwise bc1 or bc3 depending on alpha if s3tc is available */
+    if (kind.get() == texkind_normal || s3tcsupported) {
+        if (kind.get() == texkind_normal)
+            pt.format = GL_COMPRESSED_RG_RGTC2;
+        else {
+            pt.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            for (std::size_t i = 3; i < static_cast<std::size_t>(x) * y * 4; i += 4)
+                if (data[i] != 255) {
+                    pt.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+                    break;
+                }
+        }
+        encodetexchain(data, x, y, pt.format, pt.levels, pt.blob);
+        stbi_image_free(data);
+        writetexcache(cachepath, hash, kind.get(), pt.format, pt.levels, pt.blob);
+        pt.data = pt.blob.data();
+        return;
+    }
+
+    /* otherwise keep raw rgba as single level */
+    texcachelevel level = { 0, static_cast<std::uint32_t>(x), static_cast<std::uint32_t>(y), static_cast<std::uint32_t>(x * y * 4), 0 };
+    pt.format = GL_RGBA8;
+    pt.levels.assign(1, level);
+    pt.blob.assign(data, data + level.size);
+    pt.data = pt.blob.data();
+    stbi_image_free(data);
+
+}
+
+/* textures whose data is not uploaded yet, the render thread binds the placeholder instead */
+static std::unordered_set<GLuint> pendingtex;
+static GLuint placeholdertex = 0;
+
+static GLuint genplaceholdertex() {
 
     /* generate and bind texture */
     GLuint tex;
     glGenTextures(1, &tex);
     glBindTexture(GL_TEXTURE_2D, tex);
 
-    /* set texture params */
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    /* set texture params */
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    /* single mid gray texel, reads as flat for normal maps */
+    static const unsigned char gray[4] = { 128, 128, 128, 255 };
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gray);
+
+    /* unbind and return texture */
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return tex;
+
+}
+
+static void uploadtex(GLuint tex, preparedtex& pt) {
+
+    /* stage all levels in orphaned pixel unpack buffer */
+    static GLuint pbo = 0;
+    if (pbo == 0)
+        glGenBuffers(1, &pbo);
+    std::size_t size = pt.levels.back().offset + pt.levels.back().size;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    assert(dst != nullptr);
+    std::memcpy(dst, pt.data, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    /* first bind creates the texture in whichever context uploads it */
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (pt.format == GL_RGBA8) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, pt.levels[0].width, pt.levels[0].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(pt.levels.size()) - 1);
+        for (std::size_t i = 0; i < pt.levels.size(); ++i)
+            glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), pt.format, pt.levels[i].width, pt.levels[i].height, 0, pt.levels[i].size, reinterpret_cast<const void*>(pt.levels[i].offset));
+    }
+
+    /* unbind, release staged data */
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    unmapfile(pt.cache);
+    pt.blob.clear();
+
+}
+
+static GLuint loadtex(const std::string& imgpath, std::shared_future<int> kind) {
+
+    /* hand out name right away, it reads as placeholder until a worker prepared and uploaded it */
+    if (placeholdertex == 0)
+        placeholdertex = genplaceholdertex();
+    GLuint tex;
+    glGenTextures(1, &tex);
+    pendingtex.insert(tex);
+    std::shared_ptr<preparedtex> pt = std::make_shared<preparedtex>();
+    submitjob([=]() {
+        std::uint64_t hash = 0;
+        bool hashed = hashfile(imgpath, hash);
+        assert(hashed);
+        preparetex(imgpath, hash, kind, *pt);
+        submitupload([=]() { uploadtex(tex, *pt); }, [=]() { pendingtex.erase(tex); });
+    });
+    return tex;
+
+}
+
+static GLuint readytex(GLuint tex) {
+
+    /* swap in placeholder while texture is pending */
+    return pendingtex.count(tex) > 0 ? placeholdertex : tex;
+
+}
+
+static GLuint loadtex(const std::string& imgpath, int kind = texkind_color) {
+
+    /* kind is known up front */
+    std::promise<int> known;
+    known.set_value(kind);
+    return loadtex(imgpath, known.get_future().share());
+
+}
+
+/* scene textures live in arrays bucketed by format, full resolution size and levels, bound to consecutive units */
+#define texarray_maxbuckets 8
+#define texarray_minlayers 4
+#define texarray_location(bucket, layer) (static_cast<GLint>(bucket) << 16 | static_cast<GLint>(layer))
+
+/* registered scene texture, levels are read from its mapped cache and resident is the finest level uploaded to its layer, raw rgba is pinned at full resolution */
+typedef struct {
+    preparedtex source;
+    std::uint64_t key;
+    std::uint32_t refs;
+    std::uint32_t resident;
+    std::uint32_t wanted;
+    std::uint64_t lastused;
+    GLint location;
+    GLint vtex;                 /* virtual texture index, -1 for arrayed textures */
+    bool pinned;
+    bool streaming;
+    bool unplaced;              /* no bucket left for it, never streamed */
+} streamtex;
+
+/* texture array of one format, full resolution size and level count, layers hold texture ids or -1 when free */
+typedef struct {
+    GLuint array;
+    GLenum format;
+    GLsizei width, height, nlevels;
+    std::vector<GLint> layers;
+} texbucket;
+
+/* texture table entry read by phong_fs, location is -1 until placed, full resolution size scales feedback and lod, min level clamps sampling to the uploaded levels, std430 layout */
+typedef struct {
+    GLint location;
+    GLint width, height;
+    GLint minlevel;
+} texentry;
+
+/* virtual textures are cut into pages with borders and paged from a tiled file into an atlas, beyond the array size limit */
+#define vtex_magic 0x54564152u /* "RAVT" */
+#define vtex_version 1u
+#define vtex_max 2
+#define vtex_maxlevels 12
+#define vtex_pagesize 128
+#define vtex_border 4
+#define vtex_slotsize (vtex_pagesize + 2 * vtex_border)
+#define vtex_atlaspages 32
+#define vtex_maxinflight 8
+typedef struct __attribute__((packed)) {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t hash;         /* source image contents, 0 for tiles written by other tools */
+    std::uint32_t kind;
+    std::uint32_t format;
+    std::uint32_t width, height;
+    std::uint32_t nlevels;      /* down to a single page */
+    std::uint32_t npages;
+} vtexheader;
+
+/* tiled file page table entry, pages are stored level by level in rows */
+typedef struct __attribute__((packed)) {
+    std::uint64_t offset;       /* from start of file */
+    std::uint32_t size;
+    std::uint32_t reserved;
+} vtexpage;
+
+/* opened virtual texture, page state is indexed like page table texels whose levels are padded to powers of two */
+typedef struct {
+    mappedfile file;
+    const vtexpage* pages;
+    GLenum format;
+    GLint width, height, nlevels;
+    GLint tablewidth, tableheight;
+    GLint id;                               /* scene texture id */
+    std::size_t fileoffsets[vtex_maxlevels];  /* first file page of each level */
+    std::size_t tableoffsets[vtex_maxlevels]; /* first page table texel of each level */
+    std::size_t firstbit;                   /* first feedback bit */
+    std::vector<GLuint> entries;            /* atlas slot and level of the page or its nearest resident ancestor */
+    std::vector<GLint> slots;               /* atlas slot per page, -1 when not resident */
+    std::vector<std::uint64_t> lastused;
+    std::vector<char> loading;
+    std::vector<GLint> owners;              /* page per atlas slot, -1 when free */
+    std::size_t inflight;
+    GLuint atlas, pagetable;
+    bool dirty;
+} vtexture;
+
+/* process wide texture registry, scenes share textures whose contents, kind and sampler state match, render thread only */
+#define texsampler_array 0
+#define texsampler_virtual 1
+#define texregistry_initialsize 16
+typedef struct {
+    std::vector<streamtex> textures;
+    std::vector<GLint> freeids;
+    std::unordered_map<std::uint64_t, GLint> keys;
+    std::vector<texbucket> texbuckets;
+    std::vector<vtexture> vtextures;        /* slots with negative id are free */
+    GLuint textable;
+    GLuint texfeedback;
+    std::size_t capacity;                   /* entries in table and feedback */
+    GLuint vtexrequests;
+    std::size_t vtexbits;
+    GLsync texfeedbackfence;
+    std::uint64_t texframe, texfeedbackframe;
+    std::size_t texbytes;
+} texregistry;
+static texregistry texreg;
+
+/* particle data */
+typedef struct __attribute__((packed)) {
+    float x, y, z;
+    float vx, vy, vz;
+    float ax, ay, az;
+    float scale;
+    float initialx, initialy, initialz;
+    float initialvx, initialvy, initialvz;
+} particle;
+
+/* particle snapshot file header, raw particle data follows */
+#define snapshot_magic 0x53504152u /* "RAPS" */
+#define snapshot_version 1u
+typedef struct __attribute__((packed)) {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t szp;
+    std::uint32_t np;
+} snapshotheader;
+
+static GLuint genparticletex(const particle* snapshot = nullptr) {
+
+    /* generate and bind texture */
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_RECTANGLE, tex);
+
+    /* set texture params */
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    /* upload snapshot as is if given */
+    #define nparticles 8192
+    #define szparticle (sizeof(particle) / sizeof(float))
+    if (snapshot != nullptr) {
+        glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_R32F, szparticle, nparticles, 0, GL_RED, GL_FLOAT, snapshot);
+        glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+        return tex;
+    }
+
+    /* allocate particle data */
+    std::vector<particle> data;
+    data.reserve(nparticles);
+    particle* pdata = data.data();
+
+    /* generate initial data */
+    #define rand01() ((std::rand() % 10001) / 10000.0f)
+    #define randrange(s, e) ((s) + ((e) - (s)) * rand01())
+    for (int i = 0; i < nparticles; ++i) {
+        particle& p = pdata[i];
+        p.x = p.initialx = randrange(-5.5f, 5.5f);
+        p.y = randrange(0.0f, 5.5f);
+        p.initialy = randrange(4.5f, 6.0f);
+        p.z = p.initialz = randrange(-5.5f, 5.5f);
+        p.vx = p.initialvx = randrange(-0.5f, 0.5f);
+        p.vy = p.initialvy = randrange(-0.5f, -0.15f);
+        p.vz = p.initialvz = randrange(-0.5f, 0.5f);
+        p.ax = randrange(-0.015f, 0.015f);
+        p.ay = randrange(-0.015f, -0.001f);
+        p.az = randrange(-0.015f, 0.015f);
+        p.scale = randrange(0.025f, 0.085f);
+    }
+
+    /* load texture */
+    glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_R32F, szparticle, nparticles, 0, GL_RED, GL_FLOAT, pdata);
+
+    /* unbind and return texture */
+    glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+    return tex;
+
+}
+
+/* compute program uniforms and bindings */
+#define compute_particleImg_binding 0
+#define compute_deltaTime_uniform 5
+#define compute_minY_uniform 6
+#define compute_nSteps_uniform 7
+#define compute_time_uniform 8
+#define compute_fields_binding 0
+#define compute_fieldCells_binding 1
+#define compute_fieldIndices_binding 2
+#define compute_local_size 64
+#define max_substeps 8
+
+/* force field primitive, mirrors std430 layout in compute shader */
+#define field_attractor 0
+#define field_vortex 1
+#define field_gust 2
+#define field_repulsor 3
+typedef struct {
+    glm::vec4 posType;      /* position, type */
+    glm::vec4 dirStrength;  /* direction or vortex axis, strength */
+    glm::vec4 params;       /* radius of influence (0 for global), gust frequency */
+} forcefield;
+
+/* coarse grid force fields are binned into, global fields go to an extra last cell */
+#define fieldgrid_min glm::vec3(-8.0f, -3.0f, -8.0f)
+#define fieldgrid_max glm::vec3(8.0f, 7.0f, 8.0f)
+#define fieldgrid_res glm::ivec3(8, 4, 8)
+#define fieldgrid_ncells (8 * 4 * 8)
+static GLuint fieldbuffers[3] = { 0, 0, 0 };
+static float simtime = 0.0f;
+
+static bool loadfields(const std::string& filepath, std::vector<forcefield>& fields) {
+
+    /* map fields description, one primitive per line */
+    mappedfile mf;
+    if (!mapfile(filepath, mf))
+        return false;
+    std::istringstream stream(std::string(reinterpret_cast<const char*>(mf.data), mf.size));
+    unmapfile(mf);
+
+    /* parse lines, skipping blank lines and comments */
+    std::string line;
+    while (std::getline(stream, line)) {
+        std::istringstream ss(line);
+        std::string type;
+        if (!(ss >> type) || type[0] == '#')
+            continue;
+        forcefield f;
+        f.params = glm::vec4(0.0f);
+        glm::vec3 pos, dir(0.0f);
+        float strength, radius = 0.0f, frequency = 0.0f;
+        bool ok;
+        if (type == "attractor") {
+            f.posType.w = field_attractor;
+            ok = static_cast<bool>(ss >> pos.x >> pos.y >> pos.z >> strength >> radius);
+        } else if (type == "vortex") {
+            f.posType.w = field_vortex;
+            ok = static_cast<bool>(ss >> pos.x >> pos.y >> pos.z >> dir.x >> dir.y >> dir.z >> strength >> radius) && glm::dot(dir, dir) > 0.0f;
+            dir = ok ? glm::normalize(dir) : dir;
+        } else if (type == "gust") {
+            f.posType.w = field_gust;
+            ok = static_cast<bool>(ss >> pos.x >> pos.y >> pos.z >> dir.x >> dir.y >> dir.z >> strength >> radius >> frequency) && glm::dot(dir, dir) > 0.0f;
+            dir = ok ? glm::normalize(dir) : dir;
+        } else if (type == "repulsor") {
+            f.posType.w = field_repulsor;
+            ok = static_cast<bool>(ss >> pos.x >> pos.y >> pos.z >> strength >> radius);
+        } else
+            ok = false;
+        if (!ok) {
+            std::cerr << filepath << ": cannot parse \"" << line << "\"" << std::endl;
+            return false;
+        }
+        f.posType = glm::vec4(pos, f.posType.w);
+        f.dirStrength = glm::vec4(dir, strength);
+        f.params.x = radius;
+        f.params.y = frequency;
+        fields.push_back(f);
+    }
+    return true;
+
+}
+
+static void uploadfields(const std::vector<forcefield>& fields) {
+
+    /* generate buffers on first use */
+    if (fieldbuffers[0] == 0)
+        glGenBuffers(3, fieldbuffers);
+
+    /* bin every field into each cell its sphere of influence overlaps */
+    std::vector<std::vector<GLuint>> bins(fieldgrid_ncells + 1);
+    glm::vec3 cellsize = (fieldgrid_max - fieldgrid_min) / glm::vec3(fieldgrid_res.x, fieldgrid_res.y, fieldgrid_res.z);
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+        float radius = fields[i].params.x;
+        if (radius <= 0.0f) {
+            bins[fieldgrid_ncells].push_back(static_cast<GLuint>(i));
+            continue;
+        }
+        glm::vec3 pos(fields[i].posType);
+        glm::ivec3 lo, hi;
+        for (int c = 0; c < 3; ++c) {
+            lo[c] = std::max(0, std::min(fieldgrid_res[c] - 1, static_cast<int>(std::floor((pos[c] - radius - fieldgrid_min[c]) / cellsize[c]))));
+            hi[c] = std::max(0, std::min(fieldgrid_res[c] - 1, static_cast<int>(std::floor((pos[c] + radius - fieldgrid_min[c]) / cellsize[c]))));
+        }
+        for (int z = lo.z; z <= hi.z; ++z)
+            for (int y = lo.y; y <= hi.y; ++y)
+                for (int x = lo.x; x <= hi.x; ++x)
+                    bins[x + fieldgrid_res.x * (y + fieldgrid_res.y * z)].push_back(static_cast<GLuint>(i));
+    }
+
+    /* flatten bins into (offset, count) cells and one index list */
+    std::vector<GLuint> cells, indices;
+    cells.reserve(2 * bins.size());
+    for (const std::vector<GLuint>& bin : bins) {
+        cells.push_back(static_cast<GLuint>(indices.size()));
+        cells.push_back(static_cast<GLuint>(bin.size()));
+        indices.insert(indices.end(), bin.begin(), bin.end());
+    }
+
+    /* upload, never leaving a buffer empty */
+    forcefield nofield = { glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, fieldbuffers[0]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<std::size_t>(1, fields.size()) * sizeof(forcefield), fields.empty() ? &nofield : fields.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, fieldbuffers[1]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, cells.size() * sizeof(GLuint), cells.data(), GL_DYNAMIC_DRAW);
+    indices.push_back(0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, fieldbuffers[2]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+}
+
+static void stepparticles(GLuint compute_prog, GLuint particletex, float deltatime, int nsteps = 1) {
+
+    /* bind compute program */
+    glUseProgram(compute_prog);
+
+    /* bind particle data for in-place update */
+    glBindImageTexture(compute_particleImg_binding, particletex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+
+    /* bind binned force fields */
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, compute_fields_binding, fieldbuffers[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, compute_fieldCells_binding, fieldbuffers[1]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, compute_fieldIndices_binding, fieldbuffers[2]);
+
+    /* bind delta time, min y limit, number of steps to integrate and simulation time at the first step */
+    glUniform1f(compute_deltaTime_uniform, deltatime);
+    glUniform1f(compute_minY_uniform, -2.0);
+    glUniform1i(compute_nSteps_uniform, nsteps);
+    glUniform1f(compute_time_uniform, simtime);
+    simtime += nsteps * deltatime;
+
+    /* compute new values, one invocation per particle running all steps */
+    glDispatchCompute((nparticles + compute_local_size - 1) / compute_local_size, 1, 1);
+
+    /* make image stores visible to following texture fetches, image loads and readbacks */
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+}
+
+static bool loadsnapshot(const std::string& filepath, mappedfile& mf, const particle*& snapshot) {
+
+    /* map snapshot file */
+    snapshot = nullptr;
+    if (!mapfile(filepath, mf))
+        return false;
+
+    /* validate header against this build's particle layout */
+    const snapshotheader* header = reinterpret_cast<const snapshotheader*>(mf.data);
+    std::size_t szdata = nparticles * sizeof(particle);
+    if (mf.size != sizeof(snapshotheader) + szdata || header->magic != snapshot_magic || header->version != snapshot_version || header->szp != szparticle || header->np != nparticles) {
+        unmapfile(mf);
+        return false;
+    }
+
+    /* particle data directly follows header */
+    snapshot = reinterpret_cast<const particle*>(mf.data + sizeof(snapshotheader));
+    return true;
+
+}
+
+static void savesnapshot(const std::string& filepath, GLuint particletex) {
+
+    /* read back particle texture */
+    std::vector<particle> data(nparticles);
+    glBindTexture(GL_TEXTURE_RECTANGLE, particletex);
+    glGetTexImage(GL_TEXTURE_RECTANGLE, 0, GL_RED, GL_FLOAT, data.data());
+    glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+
+    /* write header and data */
+    snapshotheader header = { snapshot_magic, snapshot_version, static_cast<std::uint32_t>(szparticle), nparticles };
+    std::ofstream stream(filepath, std::ios::out | std::ios::binary | std::ios::trunc);
+    assert(stream.good());
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(particle)));
+    stream.close();
+
+}
+
+/* particle recording file header, followed by per-particle scales, chunks and the chunk offset index */
+#define record_magic 0x52504152u /* "RAPR" */
+#define record_version 1u
+#define record_chunk_frames 32
+#define record_ring_frames 8
+#define record_dt (1.0f / 60.0f)
+#define record_qmax 65535.0f
+typedef struct __attribute__((packed)) {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t np;
+    std::uint32_t nframes;
+    std::uint32_t nchunks;
+    float dt;
+    std::uint64_t indexoffset;
+} recordheader;
+
+/* chunk header, followed by zigzag varint deltas of 16-bit quantized positions (planar x, y, z per frame) */
+typedef struct __attribute__((packed)) {
+    std::uint32_t nframes;
+    std::uint32_t szpayload;
+    float min[3];
+    float max[3];
+} recordchunkheader;
+
+/* recording state */
+typedef struct {
+    std::ofstream stream;
+    recordheader header;
+    std::vector<std::uint64_t> chunkoffsets;
+    std::vector<float> chunkframes;
+    int nchunkframes;
+    GLuint pbos[2];
+    int pboindex;
+    bool pending;
+} recorder;
+
+static void writechunk(recorder& r) {
+
+    /* nothing to write for empty chunk */
+    if (r.nchunkframes == 0)
+        return;
+
+    /* find chunk bounds, slightly padded so that bounds are never degenerate */
+    recordchunkheader chunkheader;
+    chunkheader.nframes = static_cast<std::uint32_t>(r.nchunkframes);
+    for (std::size_t c = 0; c < 3; ++c) {
+        chunkheader.min[c] = chunkheader.max[c] = r.chunkframes[c];
+        for (std::size_t i = c; i < static_cast<std::size_t>(r.nchunkframes) * nparticles * 3; i += 3) {
+            chunkheader.min[c] = std::min(chunkheader.min[c], r.chunkframes[i]);
+            chunkheader.max[c] = std::max(chunkheader.max[c], r.chunkframes[i]);
+        }
+        chunkheader.max[c] += 1e-4f;
+    }
+
+    /* quantize and delta encode frame after frame, deltas of first frame are relative to zero */
+    std::vector<unsigned char> payload;
+    std::vector<std::int32_t> prev(nparticles * 3, 0);
+    for (int f = 0; f < r.nchunkframes; ++f) {
+        const float* frame = r.chunkframes.data() + f * nparticles * 3;
+        for (int c = 0; c < 3; ++c) {
+            float qscale = record_qmax / (chunkheader.max[c] - chunkheader.min[c]);
+            for (int i = 0; i < nparticles; ++i) {
+                std::int32_t q = static_cast<std::int32_t>((frame[3 * i + c] - chunkheader.min[c]) * qscale + 0.5f);
+                std::int32_t delta = q - prev[c * nparticles + i];
+                prev[c * nparticles + i] = q;
+                std::uint32_t zz = (static_cast<std::uint32_t>(delta) << 1) ^ static_cast<std::uint32_t>(delta >> 31);
+                while (zz >= 0x80) {
+                    payload.push_back(static_cast<unsigned char>(zz | 0x80));
+                    zz >>= 7;
+                }
+                payload.push_back(static_cast<unsigned char>(zz));
+            }
+        }
+    }
+    chunkheader.szpayload = static_cast<std::uint32_t>(payload.size());
+
+    /* write chunk and remember its offset */
+    r.chunkoffsets.push_back(static_cast<std::uint64_t>(r.stream.tellp()));
+    r.stream.write(reinterpret_cast<const char*>(&chunkheader), sizeof(chunkheader));
+    r.stream.write(reinterpret_cast<const char*>(payload.data()), static_cast<std::streamsize>(payload.size()));
+    r.header.nframes += chunkheader.nframes;
+    r.nchunkframes = 0;
+
+}
+
+static void collectframe(recorder& r, GLuint pbo) {
+
+    /* map filled pbo and append its positions to current chunk */
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    const particle* data = static_cast<const particle*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, nparticles * sizeof(particle), GL_MAP_READ_BIT));
+    assert(data != nullptr);
+    float* frame = r.chunkframes.data() + r.nchunkframes * nparticles * 3;
+    for (int i = 0; i < nparticles; ++i) {
+        frame[3 * i] = data[i].x;
+        frame[3 * i + 1] = data[i].y;
+        frame[3 * i + 2] = data[i].z;
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    /* flush chunk when full */
+    if (++r.nchunkframes == record_chunk_frames)
+        writechunk(r);
+
+}
+
+static void beginrecording(recorder& r, const std::string& filepath, GLuint particletex) {
+
+    /* open stream and write provisional header */
+    r.stream.open(filepath, std::ios::out | std::ios::binary | std::ios::trunc);
+    assert(r.stream.good());
+    r.header = { record_magic, record_version, nparticles, 0, 0, record_dt, 0 };
+    r.stream.write(reinterpret_cast<const char*>(&r.header), sizeof(r.header));
+
+    /* scales never change, so store them once */
+    std::vector<particle> data(nparticles);
+    glBindTexture(GL_TEXTURE_RECTANGLE, particletex);
+    glGetTexImage(GL_TEXTURE_RECTANGLE, 0, GL_RED, GL_FLOAT, data.data());
+    glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+    for (const particle& p : data)
+        r.stream.write(reinterpret_cast<const char*>(&p.scale), sizeof(p.scale));
+
+    /* allocate chunk storage and readback pbos */
+    r.chunkframes.resize(record_chunk_frames * nparticles * 3);
+    r.nchunkframes = 0;
+    glGenBuffers(2, r.pbos);
+    for (int i = 0; i < 2; ++i) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, nparticles * sizeof(particle), nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    r.pboindex = 0;
+    r.pending = false;
+
+}
+
+static void recordframe(recorder& r, GLuint particletex) {
+
+    /* start asynchronous readback of current particle texture */
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbos[r.pboindex]);
+    glBindTexture(GL_TEXTURE_RECTANGLE, particletex);
+    glGetTexImage(GL_TEXTURE_RECTANGLE, 0, GL_RED, GL_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    /* collect frame read back one frame ago from other pbo, its transfer has had a whole frame to finish */
+    r.pboindex ^= 1;
+    if (r.pending)
+        collectframe(r, r.pbos[r.pboindex]);
+    r.pending = true;
+
+}
+
+static void endrecording(recorder& r) {
+
+    /* collect last frame and flush partial chunk */
+    if (r.pending)
+        collectframe(r, r.pbos[r.pboindex ^ 1]);
+    writechunk(r);
+
+    /* write chunk index, then rewrite final header */
+    r.header.nchunks = static_cast<std::uint32_t>(r.chunkoffsets.size());
+    r.header.indexoffset = static_cast<std::uint64_t>(r.stream.tellp());
+    r.stream.write(reinterpret_cast<const char*>(r.chunkoffsets.data()), static_cast<std::streamsize>(r.chunkoffsets.size() * sizeof(std::uint64_t)));
+    r.stream.seekp(0);
+    r.stream.write(reinterpret_cast<const char*>(&r.header), sizeof(r.header));
+    r.stream.close();
+
+    /* delete pbos */
+    glDeleteBuffers(2, r.pbos);
+
+}
+
+/* playback state, a decoder thread fills a ring of decoded frames ahead of the render loop */
+typedef struct {
+    mappedfile file;
+    const recordheader* header;
+    const float* scales;
+    const std::uint64_t* chunkoffsets;
+    std::vector<float> ring;
+    std::uint64_t produced, consumed;
+    float clock;                /* time not yet played back, in seconds */
+    bool quit;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread decoder;
+    GLuint pbos[2];
+    int pboindex;
+} player;
+
+static void decodeframes(player* p) {
+
+    /* loop over recording forever */
+    std::vector<std::int32_t> q(nparticles * 3);
+    for (std::uint32_t chunk = 0;; chunk = (chunk + 1) % p->header->nchunks) {
+
+        /* locate chunk and ask kernel to read ahead the one after it, chunks were checked to lie in order before the index */
+        const unsigned char* chunkdata = p->file.data + p->chunkoffsets[chunk];
+        const recordchunkheader* chunkheader = reinterpret_cast<const recordchunkheader*>(chunkdata);
+        const unsigned char* src = chunkdata + sizeof(recordchunkheader);
+        const unsigned char* end = src + chunkheader->szpayload;
+        if (chunk + 1 < p->header->nchunks) {
+            static const std::uintptr_t pagemask = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE)) - 1;
+            std::uintptr_t next = reinterpret_cast<std::uintptr_t>(p->file.data + p->chunkoffsets[chunk + 1]);
+            std::uintptr_t nextend = reinterpret_cast<std::uintptr_t>(p->file.data + (chunk + 2 < p->header->nchunks ? p->chunkoffsets[chunk + 2] : p->header->indexoffset));
+            madvise(reinterpret_cast<void*>(next & ~pagemask), nextend - (next & ~pagemask), MADV_WILLNEED);
+        }
+
+        /* decode chunk frame after frame, restarting deltas from zero */
+        std::fill(q.begin(), q.end(), 0);
+        for (std::uint32_t f = 0; f < chunkheader->nframes; ++f) {
+
+            /* wait for free ring slot */
+            std::unique_lock<std::mutex> lock(p->mutex);
+            p->cv.wait(lock, [p] { return p->quit || p->produced - p->consumed < record_ring_frames; });
+            if (p->quit)
+                return;
+            float* frame = p->ring.data() + (p->produced % record_ring_frames) * nparticles * 3;
+            lock.unlock();
+
+            /* accumulate deltas and dequantize into slot, a short or corrupt payload decodes as zero deltas rather than reading past its chunk */
+            for (int c = 0; c < 3; ++c) {
+                float qstep = (chunkheader->max[c] - chunkheader->min[c]) / record_qmax;
+                for (int i = 0; i < nparticles; ++i) {
+                    std::uint32_t zz = 0;
+                    for (int shift = 0;; shift += 7) {
+                        unsigned char byte = src < end ? *src++ : 0;
+                        zz |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+                        if ((byte & 0x80) == 0 || shift >= 28)
+                            break;
+                    }
+                    q[c * nparticles + i] += static_cast<std::int32_t>(zz >> 1) ^ -static_cast<std::int32_t>(zz & 1);
+                    frame[3 * i + c] = chunkheader->min[c] + q[c * nparticles + i] * qstep;
+                }
+            }
+
+            /* publish slot */
+            lock.lock();
+            ++p->produced;
+            p->cv.notify_all();
+
+        }
+
+    }
+
+}
+
+static bool beginplayback(player& p, const std::string& filepath, GLuint particletex) {
+
+    /* map recording and validate header, scales and index must fit without overflowing */
+    if (!mapfile(filepath, p.file))
+        return false;
+    p.header = reinterpret_cast<const recordheader*>(p.file.data);
+    std::uint64_t szscales = static_cast<std::uint64_t>(nparticles) * sizeof(float);
+    if (p.file.size < sizeof(recordheader) || p.header->magic != record_magic || p.header->version != record_version || p.header->np != nparticles || p.header->nchunks == 0
+        || !(p.header->dt > 0.0f && p.header->dt <= 1.0f) || p.header->indexoffset < sizeof(recordheader) + szscales || p.header->indexoffset > p.file.size
+        || p.header->nchunks > (p.file.size - p.header->indexoffset) / sizeof(std::uint64_t)) {
+        unmapfile(p.file);
+        return false;
+    }
+    p.scales = reinterpret_cast<const float*>(p.file.data + sizeof(recordheader));
+    p.chunkoffsets = reinterpret_cast<const std::uint64_t*>(p.file.data + p.header->indexoffset);
+
+    /* chunks lie in order between scales and index with their payloads, and at least one holds frames so decoding never spins */
+    std::uint64_t chunkstart = sizeof(recordheader) + szscales, nframes = 0;
+    for (std::uint32_t chunk = 0; chunk < p.header->nchunks; ++chunk) {
+        std::uint64_t offset = p.chunkoffsets[chunk];
+        if (offset < chunkstart || offset > p.header->indexoffset || p.header->indexoffset - offset < sizeof(recordchunkheader)) {
+            unmapfile(p.file);
+            return false;
+        }
+        const recordchunkheader* chunkheader = reinterpret_cast<const recordchunkheader*>(p.file.data + offset);
+        if (chunkheader->szpayload > p.header->indexoffset - offset - sizeof(recordchunkheader)) {
+            unmapfile(p.file);
+            return false;
+        }
+        chunkstart = offset + sizeof(recordchunkheader) + chunkheader->szpayload;
+        nframes += chunkheader->nframes;
+    }
+    if (nframes == 0) {
+        unmapfile(p.file);
+        return false;
+    }
+
+    /* upload recorded scales into their particle texture column */
+    glBindTexture(GL_TEXTURE_RECTANGLE, particletex);
+    glTexSubImage2D(GL_TEXTURE_RECTANGLE, 0, offsetof(particle, scale) / sizeof(float), 0, 1, nparticles, GL_RED, GL_FLOAT, p.scales);
+    glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+
+    /* allocate double buffered upload pbos */
+    glGenBuffers(2, p.pbos);
+    for (int i = 0; i < 2; ++i) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, p.pbos[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, nparticles * 3 * sizeof(float), nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    p.pboindex = 0;
+
+    /* start decoder thread */
+    p.ring.resize(record_ring_frames * nparticles * 3);
+    p.produced = p.consumed = 0;
+    p.clock = 0.0f;
+    p.quit = false;
+    p.decoder = std::thread(decodeframes, &p);
+    return true;
+
+}
+
+static void playbackframe(player& p, GLuint particletex, float deltatime) {
+
+    /* frames due at the recorded timestep, skipping all but the last, time owed for frames not decoded yet is dropped */
+    p.clock += deltatime;
+    std::uint64_t due = static_cast<std::uint64_t>(p.clock / p.header->dt);
+    p.clock -= due * p.header->dt;
+    std::unique_lock<std::mutex> lock(p.mutex);
+    due = std::min(due, p.produced - p.consumed);
+    if (due == 0)
+        return;
+    p.consumed += due - 1;
+    const float* frame = p.ring.data() + (p.consumed % record_ring_frames) * nparticles * 3;
+    lock.unlock();
+
+    /* copy frame into next pbo */
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, p.pbos[p.pboindex]);
+    void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, nparticles * 3 * sizeof(float), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    assert(dst != nullptr);
+    std::memcpy(dst, frame, nparticles * 3 * sizeof(float));
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    /* release ring slot */
+    lock.lock();
+    ++p.consumed;
+    p.cv.notify_all();
+    lock.unlock();
+
+    /* upload positions from pbo into x, y, z columns */
+    glBindTexture(GL_TEXTURE_RECTANGLE, particletex);
+    glTexSubImage2D(GL_TEXTURE_RECTANGLE, 0, 0, 0, 3, nparticles, GL_RED, GL_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    p.pboindex ^= 1;
+
+}
+
+static void endplayback(player& p) {
+
+    /* stop decoder thread */
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        p.quit = true;
+        p.cv.notify_all();
+    }
+    p.decoder.join();
+
+    /* delete pbos and unmap recording */
+    glDeleteBuffers(2, p.pbos);
+    unmapfile(p.file);
+
+}
+
+/* discrete lod chain of a mesh, level l spans offsets l to l + 1 of its indices, errors are in mesh units and bounds is a sphere */
+#define lod_maxlevels 5
+typedef struct {
+    std::uint32_t nlods;
+    std::uint32_t offsets[lod_maxlevels + 1];
+    float errors[lod_maxlevels];
+    float bounds[4];
+} meshlods;
+
+/* indirect draw command as read by glMultiDrawElementsIndirect */
+typedef struct {
+    GLuint count;
+    GLuint instancecount;
+    GLuint firstindex;
+    GLint basevertex;
+    GLuint baseinstance;
+} drawcommand;
+
+/* per draw data read by phong shaders through the draw id, material textures index the scene texture table, std430 layout */
+typedef struct {
+    GLfloat posoffset[4];
+    GLfloat posscale[4];
+    GLint textures[4];
+} drawdata;
+
+/* per instance attributes, one instance per node referencing the draw's mesh */
+typedef struct {
+    GLuint drawid;
+    GLuint node;
+} instancedata;
+
+/* triangle cluster of a large mesh, bounding sphere and normal cone with its cutoff in w, std430 layout */
+typedef struct {
+    GLfloat sphere[4];
+    GLfloat cone[4];
+    GLuint firstindex;
+    GLuint count;
+    GLuint reserved[2];
+} clusterdata;
+
+/* clusters of one visible full detail instance for cluster_cs to cull, std430 layout */
+typedef struct {
+    GLuint drawid;
+    GLuint node;
+    GLuint firstcluster;
+    GLuint nclusters;
+    GLint basevertex;
+    GLuint reserved[3];
+} clusterjob;
+
+/* draws sharing vertex format, index type and phong permutation, sub-allocated from shared buffers and submitted at once, commands hold full detail and are split by lod every frame */
+typedef struct {
+    GLuint vao, vbo, ibo, instances, draws, indirect;
+    bool packed;
+    GLenum indextype;
+    std::uint32_t features;
+    std::vector<drawcommand> commands;
+    std::vector<meshlods> lods;
+    std::vector<instancedata> instancelist;
+    GLuint clusters, clusterjobs, clustercommands, clusterinstances;
+    std::vector<GLuint> clusterfirst, clustercount;
+} drawbatch;
+
+/* axis aligned box */
+typedef struct {
+    glm::vec3 lo, hi;
+} aabb;
+
+/* model data, one draw of a batch, box bounds its mesh */
+typedef struct {
+    std::size_t batch;
+    std::size_t draw;
+    aabb box;
+} model;
+
+/* model instance bounded in scene space, instance indexes its batch's instance list */
+typedef struct {
+    std::uint32_t batch;
+    std::uint32_t instance;
+    aabb box;
+} cullitem;
+
+/* bvh node over cull items, leaves own count items from first, inner nodes have their two children at first */
+typedef struct {
+    aabb box;
+    std::uint32_t first;
+    std::uint32_t count;
+    bool leaf;
+} bvhnode;
+
+/* scene graph node, parents come before their children */
+typedef struct {
+    glm::mat4 local;
+    int parent;
+    std::vector<std::uint32_t> meshes;
+} scenenode;
+
+/* node matrices read by phong_vs, std430 layout */
+typedef struct {
+    glm::mat4 world;
+    glm::mat4 normal;
+} nodedata;
+
+/* scene data, texture remap maps scene texture ids to registry ids it holds references to, pos rot and scale place the root node */
+typedef struct {
+    GLuint texremap;
+    std::vector<GLint> texrefs;
+    std::vector<scenenode> nodes;
+    GLuint nodebuffer;
+    std::vector<model> models;
+    std::vector<drawbatch> batches;
+    std::vector<cullitem> cullitems;
+    std::vector<bvhnode> bvh;
+    glm::vec3 pos;
+    glm::quat rot;
+    glm::vec3 scale;
+} scene;
+
+/* vertex attribute data */
+#define sz_pos_attrib 3
+#define sz_uv_attrib 2
+#define sz_norm_attrib 3
+#define sz_tng_attrib 3
+#define sz_bitng_attrib 3
+#define sz_total_attrib (sz_pos_attrib + sz_uv_attrib + sz_norm_attrib + sz_tng_attrib + sz_bitng_attrib)
+typedef struct __attribute__((packed)) {
+    float pos[sz_pos_attrib];
+    float uv[sz_uv_attrib];
+    float norm[sz_norm_attrib];
+    float tng[sz_tng_attrib];
+    float bitng[sz_bitng_attrib];
+} attribs;
+
+/* packed vertex data, unorm16 positions within mesh bounds, half uvs, tangent frame as qtangent */
+typedef struct {
+    GLushort pos[4];
+    GLhalf uv[sz_uv_attrib];
+    GLshort qtangent[4];
+} packedattribs;
+
+/* material texture slots */
+#define texslot_diff 0
+#define texslot_norm 1
+#define texslot_spec 2
+#define ntexslots 3
+
+/* phong permutation features, one bit per filled texture slot, then tiled textures and packed vertices, programs are built on first use */
+#define phong_feature_virtual (1 << ntexslots)
+#define phong_feature_packed (1 << (ntexslots + 1))
+#define phong_nfeatures (ntexslots + 2)
+static GLuint phong_progs[1 << phong_nfeatures] = { 0 };
+
+/* imported mesh data owned by the importer, indices kept as raw bytes of indextype with all lod levels back to back */
+typedef struct {
+    std::vector<attribs> vertices;
+    std::vector<unsigned char> indices;
+    GLenum indextype;
+    meshlods lods;
+    std::string texnames[ntexslots];
+} meshdata;
+
+/* view of mesh data, either into meshdata or into a mapped mesh cache */
+typedef struct {
+    const attribs* vertices;
+    std::uint32_t nvertices;
+    const void* indices;
+    std::uint32_t nindices;
+    GLenum indextype;
+    meshlods lods;
+    std::string texnames[ntexslots];
+} meshview;
+
+/* assimp import settings, both are part of the mesh cache key */
+#define scene_rvc_flags (aiComponent_COLORS | aiComponent_BONEWEIGHTS | aiComponent_ANIMATIONS | aiComponent_TEXTURES | aiComponent_LIGHTS | aiComponent_CAMERAS)
+#define scene_import_flags (aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices | aiProcess_Triangulate | aiProcess_RemoveComponent | aiProcess_GenSmoothNormals | aiProcess_PreTransformVertices | aiProcess_RemoveRedundantMaterials)
+#define scene_hierarchy_import_flags (scene_import_flags & ~aiProcess_PreTransformVertices)
+
+/* mesh cache file header, followed by mesh entries, node entries, node mesh indices, string table and 16 byte aligned blobs */
+#define meshcache_magic 0x434d4152u /* "RAMC" */
+#define meshcache_version 5u
+#define meshcache_align 16
+#define meshcache_notex 0xffffffffu
+typedef struct __attribute__((packed)) {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t hash;
+    std::uint32_t rvcflags;
+    std::uint32_t importflags;
+    std::uint32_t nmeshes;
+    std::uint32_t nnodes;
+    std::uint32_t nnodemeshes;
+    std::uint32_t szstrings;
+} meshcacheheader;
+
+typedef struct __attribute__((packed)) {
+    float local[16];
+    std::int32_t parent;
+    std::uint32_t firstmesh;
+    std::uint32_t nmeshes;
+    std::uint32_t reserved;
+} meshcachenode;
+
+typedef struct __attribute__((packed)) {
+    std::uint64_t vertexoffset;
+    std::uint64_t indexoffset;
+    std::uint32_t nvertices;
+    std::uint32_t nindices;
+    std::uint32_t texnames[ntexslots];
+    std::uint32_t indextype;
+    meshlods lods;
+} meshcacheentry;
+
+static std::size_t indexsize(GLenum indextype) {
+
+    /* bytes per index of either supported type */
+    assert(indextype == GL_UNSIGNED_SHORT || indextype == GL_UNSIGNED_INT);
+    return indextype == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+}
+
+/* mesh optimization, fifo cache size for reordering and allowed acmr growth when splitting overdraw clusters */
+#define optimize_cache_size 16
+#define optimize_overdraw_threshold 1.05f
+
+static void optimizemesh(meshdata& md) {
+
+    /* widen indices */
+    std::size_t nindices = md.indices.size() / indexsize(md.indextype), ntris = nindices / 3, nverts = md.vertices.size();
+    if (ntris == 0)
+        return;
+    std::vector<GLuint> indices(nindices);
+    for (std::size_t i = 0; i < nindices; ++i)
+        indices[i] = md.indextype == GL_UNSIGNED_SHORT ? reinterpret_cast<const GLushort*>(md.indices.data())[i] : reinterpret_cast<const GLuint*>(md.indices.data())[i];
+
+    /* build vertex to triangle adjacency, live counts track triangles not emitted yet */
+    std::vector<GLuint> live(nverts, 0), adjoffsets(nverts + 1, 0), adjacency(nindices);
+    for (GLuint v : indices)
+        ++live[v];
+    for (std::size_t v = 0; v < nverts; ++v)
+        adjoffsets[v + 1] = adjoffsets[v] + live[v];
+    std::vector<GLuint> adjfill(adjoffsets.begin(), adjoffsets.end() - 1);
+    for (std::size_t t = 0; t < ntris; ++t)
+        for (int k = 0; k < 3; ++k)
+            adjacency[adjfill[indices[3 * t + k]]++] = static_cast<GLuint>(t);
+
+    /* tipsify, fan triangles around vertices likely still in cache, note where it had to jump */
+    std::vector<GLuint> order, candidates, deadends;
+    std::vector<std::size_t> hardbounds(1, 0);
+    std::vector<int> stamps(nverts, 0);
+    std::vector<bool> emitted(ntris, false);
+    int stamp = optimize_cache_size + 1;
+    std::size_t cursor = 0;
+    order.reserve(ntris);
+    for (long fan = 0; fan >= 0;) {
+
+        /* emit all remaining triangles around fanning vertex */
+        candidates.clear();
+        for (GLuint a = adjoffsets[fan]; a < adjoffsets[fan + 1]; ++a) {
+            GLuint t = adjacency[a];
+            if (emitted[t])
+                continue;
+            for (int k = 0; k < 3; ++k) {
+                GLuint v = indices[3 * t + k];
+                deadends.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (stamp - stamps[v] > optimize_cache_size)
+                    stamps[v] = stamp++;
+            }
+            emitted[t] = true;
+            order.push_back(t);
+        }
+
+        /* pick candidate that stays in cache longest after its remaining triangles */
+        long next = -1;
+        int best = -1;
+        for (GLuint v : candidates)
+            if (live[v] > 0) {
+                int priority = stamp - stamps[v] + 2 * static_cast<int>(live[v]) <= optimize_cache_size ? stamp - stamps[v] : 0;
+                if (priority > best) {
+                    best = priority;
+                    next = v;
+                }
+            }
+
+        /* dead end, fall back to recently used vertices, then to a linear scan */
+        if (next < 0) {
+            while (next < 0 && !deadends.empty()) {
+                if (live[deadends.back()] > 0)
+                    next = deadends.back();
+                deadends.pop_back();
+            }
+            while (next < 0 && cursor < nverts)
+                if (live[cursor] > 0)
+                    next = static_cast<long>(cursor);
+                else
+                    ++cursor;
+            if (next >= 0 && order.size() > hardbounds.back())
+                hardbounds.push_back(order.size());
+        }
+        fan = next;
+
+    }
+    hardbounds.push_back(ntris);
+
+    /* fifo cache simulation, bumping tick by the cache size flushes it */
+    std::vector<std::size_t> cachetimes(nverts, 0);
+    std::size_t tick = optimize_cache_size;
+    auto misses = [&](GLuint t) {
+        int n = 0;
+        for (int k = 0; k < 3; ++k) {
+            GLuint v = indices[3 * t + k];
+            if (tick - cachetimes[v] >= optimize_cache_size) {
+                cachetimes[v] = tick++;
+                ++n;
+            }
+        }
+        return n;
+    };
+
+    /* split jumps into smaller clusters as long as their acmr stays close to the whole run's */
+    std::vector<std::size_t> clusters;
+    for (std::size_t c = 0; c + 1 < hardbounds.size(); ++c) {
+        std::size_t begin = hardbounds[c], end = hardbounds[c + 1];
+        int total = 0;
+        tick += optimize_cache_size;
+        for (std::size_t i = begin; i < end; ++i)
+            total += misses(order[i]);
+        float threshold = optimize_overdraw_threshold * total / (end - begin);
+        clusters.push_back(begin);
+        std::size_t start = begin;
+        int count = 0;
+        tick += optimize_cache_size;
+        for (std::size_t i = begin; i + 1 < end; ++i) {
+            count += misses(order[i]);
+            if (count <= threshold * (i + 1 - start)) {
+                clusters.push_back(i + 1);
+                start = i + 1;
+                count = 0;
+                tick += optimize_cache_size;
+            }
+        }
+    }
+    clusters.push_back(ntris);
+
+    /* find mesh centroid */
+    glm::vec3 meshcentroid(0.0f);
+    for (const attribs& a : md.vertices)
+        meshcentroid += glm::vec3(a.pos[0], a.pos[1], a.pos[2]);
+    meshcentroid /= static_cast<float>(nverts);
+
+    /* draw clusters facing away from the centroid first, they tend to occlude the others */
+    std::vector<std::pair<float, std::size_t>> keys(clusters.size() - 1);
+    for (std::size_t c = 0; c + 1 < clusters.size(); ++c) {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (std::size_t i = clusters[c]; i < clusters[c + 1]; ++i) {
+            const GLuint* tri = &indices[3 * order[i]];
+            glm::vec3 p0(md.vertices[tri[0]].pos[0], md.vertices[tri[0]].pos[1], md.vertices[tri[0]].pos[2]);
+            glm::vec3 p1(md.vertices[tri[1]].pos[0], md.vertices[tri[1]].pos[1], md.vertices[tri[1]].pos[2]);
+            glm::vec3 p2(md.vertices[tri[2]].pos[0], md.vertices[tri[2]].pos[1], md.vertices[tri[2]].pos[2]);
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            centroid += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+        float len = glm::length(normal);
+        keys[c].first = area > 0.0f && len > 0.0f ? glm::dot(centroid / area - meshcentroid, normal / len) : 0.0f;
+        keys[c].second = c;
+    }
+    std::stable_sort(keys.begin(), keys.end(), [](const std::pair<float, std::size_t>& a, const std::pair<float, std::size_t>& b) { return a.first > b.first; });
+
+    /* renumber vertices in first use order of the final triangle order, dropping unused ones */
+    std::vector<GLuint> remap(nverts, ~0u), reordered(nindices);
+    std::vector<attribs> vertices;
+    vertices.reserve(nverts);
+    std::size_t n = 0;
+    for (const std::pair<float, std::size_t>& key : keys)
+        for (std::size_t i = clusters[key.second]; i < clusters[key.second + 1]; ++i)
+            for (int k = 0; k < 3; ++k) {
+                GLuint v = indices[3 * order[i] + k];
+                if (remap[v] == ~0u) {
+                    remap[v] = static_cast<GLuint>(vertices.size());
+                    vertices.push_back(md.vertices[v]);
+                }
+                reordered[n++] = remap[v];
+            }
+    md.vertices.swap(vertices);
+
+    /* narrow indices again, dropped vertices may now fit 16 bit */
+    md.indextype = md.vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    md.indices.resize(nindices * indexsize(md.indextype));
+    for (std::size_t i = 0; i < nindices; ++i)
+        if (md.indextype == GL_UNSIGNED_SHORT)
+            reinterpret_cast<GLushort*>(md.indices.data())[i] = static_cast<GLushort>(reordered[i]);
+        else
+            reinterpret_cast<GLuint*>(md.indices.data())[i] = reordered[i];
+
+}
+
+/* lod generation, each level aims at a fraction of the triangles of the one before and must shrink by at least the minimum ratio */
+#define lod_ratio 0.5f
+#define lod_minratio 0.8f
+#define lod_mintriangles 32
+
+/* screen space error in pixels tolerated when picking a level */
+#define lod_pixelerror 1.0f
+
+/* symmetric 4x4 error quadric, upper triangle row by row, weight counts accumulated planes */
+typedef struct {
+    double q[10];
+    double weight;
+} quadric;
+
+static void addplanequadric(quadric& q, const glm::vec3& n, double d) {
+
+    /* accumulate squared distance to plane n.p + d = 0 */
+    double planes[4] = { n.x, n.y, n.z, d };
+    for (int r = 0, k = 0; r < 4; ++r)
+        for (int c = r; c < 4; ++c)
+            q.q[k++] += planes[r] * planes[c];
+    q.weight += 1.0;
+
+}
+
+static double evalquadric(const quadric& q, const glm::vec3& pos) {
+
+    /* p^T Q p with p = (pos, 1), off diagonal terms count twice, averaged over planes to stay a squared distance */
+    double p[4] = { pos.x, pos.y, pos.z, 1.0 }, sum = 0.0;
+    for (int r = 0, k = 0; r < 4; ++r)
+        for (int c = r; c < 4; ++c)
+            sum += (r == c ? 1.0 : 2.0) * q.q[k++] * p[r] * p[c];
+    return q.weight > 0.0 ? sum / q.weight : 0.0;
+
+}
+
+static float simplifymesh(const attribs* vertices, std::size_t nvertices, std::vector<GLuint>& indices, std::size_t targetindices) {
+
+    /* weld by position, vertices split along uv or normal seams are locked so seams cannot tear */
+    std::vector<glm::vec3> positions(nvertices);
+    std::vector<GLuint> order(nvertices);
+    for (std::size_t v = 0; v < nvertices; ++v) {
+        positions[v] = glm::vec3(vertices[v].pos[0], vertices[v].pos[1], vertices[v].pos[2]);
+        order[v] = static_cast<GLuint>(v);
+    }
+    std::sort(order.begin(), order.end(), [&](GLuint a, GLuint b) {
+        return positions[a].x != positions[b].x ? positions[a].x < positions[b].x : positions[a].y != positions[b].y ? positions[a].y < positions[b].y : positions[a].z < positions[b].z;
+    });
+    std::vector<bool> locked(nvertices, false);
+    for (std::size_t i = 1; i < nvertices; ++i)
+        if (positions[order[i]] == positions[order[i - 1]])
+            locked[order[i]] = locked[order[i - 1]] = true;
+
+    /* lock open borders, edges used by a single triangle */
+    std::unordered_map<std::uint64_t, int> edges;
+    for (std::size_t i = 0; i < indices.size(); ++i) {
+        GLuint a = indices[i], b = indices[i % 3 == 2 ? i - 2 : i + 1];
+        ++edges[static_cast<std::uint64_t>(std::min(a, b)) << 32 | std::max(a, b)];
+    }
+    for (const std::pair<const std::uint64_t, int>& edge : edges)
+        if (edge.second == 1)
+            locked[edge.first >> 32] = locked[edge.first & 0xffffffffu] = true;
+
+    /* vertex quadrics from adjacent triangle planes */
+    std::vector<quadric> quadrics(nvertices, quadric());
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::vec3& p0 = positions[indices[i]];
+        glm::vec3 n = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+        if (glm::dot(n, n) <= 0.0f)
+            continue;
+        n = glm::normalize(n);
+        for (int k = 0; k < 3; ++k)
+            addplanequadric(quadrics[indices[i + k]], n, -glm::dot(n, p0));
+    }
+
+    /* collapse in passes until target is reached or nothing can move */
+    typedef struct {
+        GLuint from, to;
+        double cost;
+    } collapse;
+    float error = 0.0f;
+    std::vector<GLuint> remap(nvertices), adjacency, adjacencyoffsets(nvertices + 1);
+    std::vector<bool> touched(nvertices);
+    while (indices.size() > targetindices) {
+
+        /* collapse candidates, unlocked vertices move onto a neighbour so attributes stay valid */
+        std::vector<collapse> candidates;
+        for (std::size_t i = 0; i < indices.size(); ++i) {
+            GLuint a = indices[i], b = indices[i % 3 == 2 ? i - 2 : i + 1];
+            if (!locked[a])
+                candidates.push_back({ a, b, evalquadric(quadrics[a], positions[b]) });
+            if (!locked[b])
+                candidates.push_back({ b, a, evalquadric(quadrics[b], positions[a]) });
+        }
+        if (candidates.empty())
+            break;
+        std::sort(candidates.begin(), candidates.end(), [](const collapse& a, const collapse& b) { return a.cost < b.cost; });
+
+        /* vertex to triangle adjacency for flip checks */
+        std::fill(adjacencyoffsets.begin(), adjacencyoffsets.end(), 0);
+        for (GLuint index : indices)
+            ++adjacencyoffsets[index + 1];
+        for (std::size_t v = 0; v < nvertices; ++v)
+            adjacencyoffsets[v + 1] += adjacencyoffsets[v];
+        adjacency.resize(indices.size());
+        std::vector<GLuint> fill(adjacencyoffsets.begin(), adjacencyoffsets.end() - 1);
+        for (std::size_t i = 0; i < indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = static_cast<GLuint>(i / 3);
+
+        /* take cheapest collapses whose neighbourhoods are untouched this pass, each removes about two triangles */
+        for (std::size_t v = 0; v < nvertices; ++v)
+            remap[v] = static_cast<GLuint>(v);
+        std::fill(touched.begin(), touched.end(), false);
+        std::size_t budget = (indices.size() - targetindices + 5) / 6, ncollapsed = 0;
+        for (const collapse& c : candidates) {
+            if (ncollapsed >= budget)
+                break;
+            if (touched[c.from] || touched[c.to])
+                continue;
+
+            /* reject collapses flipping, degenerating or steeply turning a remaining triangle */
+            bool flips = false;
+            for (GLuint a = adjacencyoffsets[c.from]; a < adjacencyoffsets[c.from + 1] && !flips; ++a) {
+                const GLuint* tri = &indices[adjacency[a] * 3];
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+                    continue;
+                glm::vec3 p[3], q[3];
+                for (int k = 0; k < 3; ++k) {
+                    p[k] = positions[tri[k]];
+                    q[k] = positions[tri[k] == c.from ? c.to : tri[k]];
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]), after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                flips = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+            }
+            if (flips)
+                continue;
+
+            /* collapse, fencing off every vertex whose triangles changed */
+            remap[c.from] = c.to;
+            for (int q = 0; q < 10; ++q)
+                quadrics[c.to].q[q] += quadrics[c.from].q[q];
+            quadrics[c.to].weight += quadrics[c.from].weight;
+            error = std::max(error, static_cast<float>(std::sqrt(std::max(c.cost, 0.0))));
+            for (GLuint a = adjacencyoffsets[c.from]; a < adjacencyoffsets[c.from + 1]; ++a)
+                for (int k = 0; k < 3; ++k)
+                    touched[indices[adjacency[a] * 3 + k]] = true;
+            ++ncollapsed;
+        }
+        if (ncollapsed == 0)
+            break;
+
+        /* apply remap, dropping collapsed triangles */
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+            GLuint a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+            indices[kept++] = a;
+            indices[kept++] = b;
+            indices[kept++] = c;
+        }
+        indices.resize(kept);
+
+    }
+    return error;
+
+}
+
+static void genlods(meshdata& md) {
+
+    /* bounding sphere around box center */
+    glm::vec3 lo(0.0f), hi(0.0f);
+    for (std::size_t v = 0; v < md.vertices.size(); ++v) {
+        glm::vec3 pos(md.vertices[v].pos[0], md.vertices[v].pos[1], md.vertices[v].pos[2]);
+        lo = v == 0 ? pos : glm::min(lo, pos);
+        hi = v == 0 ? pos : glm::max(hi, pos);
+    }
+    glm::vec3 center = (lo + hi) * 0.5f;
+    float radius = 0.0f;
+    for (const attribs& a : md.vertices)
+        radius = std::max(radius, glm::length(glm::vec3(a.pos[0], a.pos[1], a.pos[2]) - center));
+    md.lods.bounds[0] = center.x;
+    md.lods.bounds[1] = center.y;
+    md.lods.bounds[2] = center.z;
+    md.lods.bounds[3] = radius;
+
+    /* full detail is level zero */
+    std::size_t nindices = md.indices.size() / indexsize(md.indextype);
+    md.lods.nlods = 1;
+    md.lods.offsets[0] = 0;
+    md.lods.offsets[1] = static_cast<std::uint32_t>(nindices);
+    md.lods.errors[0] = 0.0f;
+    std::vector<GLuint> base(nindices);
+    for (std::size_t i = 0; i < nindices; ++i)
+        base[i] = md.indextype == GL_UNSIGNED_SHORT ? reinterpret_cast<const GLushort*>(md.indices.data())[i] : reinterpret_cast<const GLuint*>(md.indices.data())[i];
+
+    /* simplify every level from full detail so errors stay measured against it, appending levels after the base indices */
+    std::size_t previous = nindices;
+    while (md.lods.nlods < lod_maxlevels) {
+        std::size_t target = static_cast<std::size_t>(previous * lod_ratio) / 3 * 3;
+        if (target / 3 < lod_mintriangles)
+            break;
+        std::vector<GLuint> level(base);
+        float error = simplifymesh(md.vertices.data(), md.vertices.size(), level, target);
+        if (level.empty() || level.size() > previous * lod_minratio)
+            break;
+        std::size_t first = md.indices.size() / indexsize(md.indextype);
+        md.indices.resize((first + level.size()) * indexsize(md.indextype));
+        for (std::size_t i = 0; i < level.size(); ++i)
+            if (md.indextype == GL_UNSIGNED_SHORT)
+                reinterpret_cast<GLushort*>(md.indices.data())[first + i] = static_cast<GLushort>(level[i]);
+            else
+                reinterpret_cast<GLuint*>(md.indices.data())[first + i] = level[i];
+        md.lods.errors[md.lods.nlods] = std::max(error, md.lods.errors[md.lods.nlods - 1]);
+        md.lods.offsets[++md.lods.nlods] = static_cast<std::uint32_t>(first + level.size());
+        previous = level.size();
+    }
+
+}
+
+static void importscene(const std::string& filepath, unsigned int importflags, std::vector<meshdata>& meshes, std::vector<scenenode>& nodes) {
+
+    /* import scene from its mapping, the extension hints the format */
+    mappedfile source;
+    bool mapped = mapfile(filepath, source);
+    assert(mapped);
+    Assimp::Importer a_importer;
+    a_importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, scene_rvc_flags);
+    const aiScene* a_scene = a_importer.ReadFileFromMemory(source.data, source.size, importflags, filepath.substr(filepath.find_last_of('.') + 1).c_str());
+    unmapfile(source);
+    assert(a_scene != nullptr);
+
+    /* flatten node tree with parents before children, pretransformed scenes leave a single root */
+    std::vector<std::pair<const aiNode*, int>> stack(1, std::make_pair(a_scene->mRootNode, -1));
+    while (!stack.empty()) {
+        const aiNode* a_node = stack.back().first;
+        scenenode node;
+        node.parent = stack.back().second;
+        stack.pop_back();
+        node.local = glm::transpose(glm::make_mat4(&a_node->mTransformation.a1));
+        node.meshes.assign(a_node->mMeshes, a_node->mMeshes + a_node->mNumMeshes);
+        for (unsigned int i = 0; i < a_node->mNumChildren; ++i)
+            stack.push_back(std::make_pair(a_node->mChildren[i], static_cast<int>(nodes.size())));
+        nodes.push_back(node);
+    }
+
+    /* convert all meshes */
+    meshes.resize(a_scene->mNumMeshes);
+    for (int i = 0; i < a_scene->mNumMeshes; ++i) {
+
+        meshdata& md = meshes[i];
+        const aiMesh* a_mesh = a_scene->mMeshes[i];
+
+        /* build vertices buffer */
+        md.vertices.resize(a_mesh->mNumVertices);
+        attribs* parrayattribs = md.vertices.data();
+        for (int j = 0; j < a_mesh->mNumVertices; ++j) {
+            parrayattribs[j].pos[0] = a_mesh->mVertices[j].x;
+            parrayattribs[j].pos[1] = a_mesh->mVertices[j].y;
+            parrayattribs[j].pos[2] = a_mesh->mVertices[j].z;
+            if (a_mesh->HasTextureCoords(0)) {
+                parrayattribs[j].uv[0] = a_mesh->mTextureCoords[0][j].x;
+                parrayattribs[j].uv[1] = a_mesh->mTextureCoords[0][j].y;
+            } else
+                parrayattribs[j].uv[0] = parrayattribs[j].uv[1] = 0.0f;
+            parrayattribs[j].norm[0] = a_mesh->mNormals[j].x;
+            parrayattribs[j].norm[1] = a_mesh->mNormals[j].y;
+            parrayattribs[j].norm[2] = a_mesh->mNormals[j].z;
+            parrayattribs[j].tng[0] = a_mesh->mTangents[j].x;
+            parrayattribs[j].tng[1] = a_mesh->mTangents[j].y;
+            parrayattribs[j].tng[2] = a_mesh->mTangents[j].z;
+            parrayattribs[j].bitng[0] = a_mesh->mBitangents[j].x;
+            parrayattribs[j].bitng[1] = a_mesh->mBitangents[j].y;
+            parrayattribs[j].bitng[2] = a_mesh->mBitangents[j].z;
+        }
+
+        /* build indices buffer, 16 bit whenever every vertex is addressable */
+        md.indextype = a_mesh->mNumVertices <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        md.indices.resize(3 * a_mesh->mNumFaces * indexsize(md.indextype));
+        GLushort* pindices16 = reinterpret_cast<GLushort*>(md.indices.data());
+        GLuint* pindices32 = reinterpret_cast<GLuint*>(md.indices.data());
+        for (int j = 0; j < a_mesh->mNumFaces; ++j) {
+            assert(a_mesh->mFaces[j].mNumIndices == 3);
+            for (int k = 0; k < 3; ++k)
+                if (md.indextype == GL_UNSIGNED_SHORT)
+                    pindices16[3 * j + k] = static_cast<GLushort>(a_mesh->mFaces[j].mIndices[k]);
+                else
+                    pindices32[3 * j + k] = a_mesh->mFaces[j].mIndices[k];
+        }
+
+        /* reorder for vertex cache, overdraw and vertex fetch */
+        optimizemesh(md);
+
+        /* get material ptr */
+        assert(a_mesh->mMaterialIndex < a_scene->mNumMaterials);
+        const aiMaterial* a_mat = a_scene->mMaterials[a_mesh->mMaterialIndex];
+
+        /* no textures if material is null */
+        if (a_mat == nullptr)
+            continue;
+
+        /* check if diffuse, normal and specular textures exist and remember their names */
+        const aiTextureType a_textypes[ntexslots] = { aiTextureType_DIFFUSE, aiTextureType_NORMALS, aiTextureType_SPECULAR };
+        for (int slot = 0; slot < ntexslots; ++slot)
+            if (a_mat->GetTextureCount(a_textypes[slot]) > 0) {
+                aiString texname;
+                a_mat->GetTexture(a_textypes[slot], 0, &texname);
+                md.texnames[slot] = texname.C_Str();
+            }
+
+    }
+
+}
+
+/* minimal json tree, enough for gltf headers */
+#define json_null 0
+#define json_bool 1
+#define json_number 2
+#define json_string 3
+#define json_array 4
+#define json_object 5
+#define json_maxdepth 64
+typedef struct jsonvalue {
+    int type;
+    double number;
+    std::string string;
+    std::vector<std::string> keys;
+    std::vector<struct jsonvalue> items;
+} jsonvalue;
+
+static void jsonskipspace(const char*& p, const char* end) {
+
+    /* skip whitespace between tokens */
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+        ++p;
+
+}
+
+static bool jsonparsestring(const char*& p, const char* end, std::string& out) {
+
+    /* read quoted string, \u escapes are encoded as utf-8 without pairing surrogates */
+    if (p >= end || *p != '"')
+        return false;
+    out.clear();
+    for (++p; p < end && *p != '"'; ++p) {
+        if (*p != '\\') {
+            out += *p;
+            continue;
+        }
+        if (++p >= end)
+            return false;
+        switch (*p) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                if (end - p < 5)
+                    return false;
+                unsigned long code = std::strtoul(std::string(p + 1, p + 5).c_str(), nullptr, 16);
+                if (code < 0x80)
+                    out += static_cast<char>(code);
+                else if (code < 0x800) {
+                    out += static_cast<char>(0xc0 | code >> 6);
+                    out += static_cast<char>(0x80 | (code & 0x3f));
+                } else {
+                    out += static_cast<char>(0xe0 | code >> 12);
+                    out += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+                    out += static_cast<char>(0x80 | (code & 0x3f));
+                }
+                p += 4;
+                break;
+            }
+            default: out += *p; break;
+        }
+    }
+    if (p >= end)
+        return false;
+    ++p;
+    return true;
+
+}
+
+static bool jsonparse(const char*& p, const char* end, jsonvalue& v, int depth = 0) {
+
+    /* dispatch on first character of value */
+    jsonskipspace(p, end);
+    if (p >= end || depth > json_maxdepth)
+        return false;
+    v.type = json_null;
+    v.number = 0.0;
+
+    /* objects and arrays, keys are only filled for objects */
+    if (*p == '{' || *p == '[') {
+        bool object = *p == '{';
+        char close = object ? '}' : ']';
+        v.type = object ? json_object : json_array;
+        ++p;
+        jsonskipspace(p, end);
+        if (p < end && *p == close) {
+            ++p;
+            return true;
+        }
+        for (;;) {
+            if (object) {
+                jsonskipspace(p, end);
+                v.keys.emplace_back();
+                if (!jsonparsestring(p, end, v.keys.back()))
+                    return false;
+                jsonskipspace(p, end);
+                if (p >= end || *p != ':')
+                    return false;
+                ++p;
+            }
+            v.items.emplace_back();
+            if (!jsonparse(p, end, v.items.back(), depth + 1))
+                return false;
+            jsonskipspace(p, end);
+            if (p < end && *p == ',')
+                ++p;
+            else if (p < end && *p == close) {
+                ++p;
+                return true;
+            } else
+                return false;
+        }
+    }
+
+    /* strings and literals */
+    if (*p == '"') {
+        v.type = json_string;
+        return jsonparsestring(p, end, v.string);
+    }
+    static const char* literals[3] = { "true", "false", "null" };
+    for (int i = 0; i < 3; ++i) {
+        std::size_t len = std::strlen(literals[i]);
+        if (static_cast<std::size_t>(end - p) >= len && std::strncmp(p, literals[i], len) == 0) {
+            v.type = i < 2 ? json_bool : json_null;
+            v.number = i == 0 ? 1.0 : 0.0;
+            p += len;
+            return true;
+        }
+    }
+
+    /* numbers, copied out since the buffer is not terminated */
+    const char* start = p;
+    while (p < end && (std::isdigit(static_cast<unsigned char>(*p)) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+        ++p;
+    if (p == start)
+        return false;
+    v.type = json_number;
+    v.number = std::strtod(std::string(start, p).c_str(), nullptr);
+    return true;
+
+}
+
+static const jsonvalue* jsonget(const jsonvalue* v, const char* key) {
+
+    /* find member of object */
+    if (v == nullptr || v->type != json_object)
+        return nullptr;
+    for (std::size_t i = 0; i < v->keys.size(); ++i)
+        if (v->keys[i] == key)
+            return &v->items[i];
+    return nullptr;
+
+}
+
+static const jsonvalue* jsonat(const jsonvalue* v, long index) {
+
+    /* find element of array */
+    if (v == nullptr || v->type != json_array || index < 0 || static_cast<std::size_t>(index) >= v->items.size())
+        return nullptr;
+    return &v->items[index];
+
+}
+
+static double jsonnumber(const jsonvalue* v, double fallback) {
+
+    /* read number, fallback if missing */
+    return v != nullptr && v->type == json_number ? v->number : fallback;
+
+}
+
+static bool jsonsize(const jsonvalue* v, double fallback, std::size_t& size) {
+
+    /* read number as a size, rejecting negative, fractional, non-finite and huge ones, comparisons fail for nan */
+    double number = jsonnumber(v, fallback);
+    if (!(number >= 0.0 && number <= 4294967295.0) || static_cast<double>(static_cast<std::uint64_t>(number)) != number)
+        return false;
+    size = static_cast<std::size_t>(number);
+    return true;
+
+}
+
+/* binary gltf container and the accessor types the fast path reads */
+#define glb_magic 0x46546c67u /* "glTF" */
+#define glb_version 2u
+#define glb_chunk_json 0x4e4f534au /* "JSON" */
+#define glb_chunk_bin 0x004e4942u /* "BIN\0" */
+#define gltf_ubyte 5121
+#define gltf_ushort 5123
+#define gltf_uint 5125
+#define gltf_float 5126
+#define gltf_triangles 4
+
+/* cache key of the native glb loader, kept apart from assimp import flags */
+#define scene_glb_import_flags 0u
+
+/* typed view of an accessor inside the mapped binary chunk */
+typedef struct {
+    const unsigned char* data;
+    std::size_t count;
+    std::size_t stride;
+    int componenttype;
+    int ncomponents;
+} gltfaccessor;
+
+static bool gltfaccess(const jsonvalue& root, const unsigned char* bin, std::size_t szbin, long index, int componenttype, int ncomponents, gltfaccessor& acc) {
+
+    /* resolve accessor and its buffer view, sparse accessors and external buffers take the assimp path */
+    const jsonvalue* accessor = jsonat(jsonget(&root, "accessors"), index);
+    const jsonvalue* view = jsonat(jsonget(&root, "bufferViews"), static_cast<long>(jsonnumber(jsonget(accessor, "bufferView"), -1.0)));
+    if (view == nullptr || jsonget(accessor, "sparse") != nullptr || jsonnumber(jsonget(view, "buffer"), -1.0) != 0.0)
+        return false;
+
+    /* check element type, componenttype 0 accepts any index type */
+    const jsonvalue* type = jsonget(accessor, "type");
+    static const char* types[4] = { "SCALAR", "VEC2", "VEC3", "VEC4" };
+    acc.ncomponents = 0;
+    for (int i = 0; i < 4; ++i)
+        if (type != nullptr && type->string == types[i])
+            acc.ncomponents = i + 1;
+    acc.componenttype = static_cast<int>(jsonnumber(jsonget(accessor, "componentType"), 0.0));
+    if (acc.ncomponents != ncomponents || (componenttype != 0 && acc.componenttype != componenttype)
+        || (componenttype == 0 && acc.componenttype != gltf_ubyte && acc.componenttype != gltf_ushort && acc.componenttype != gltf_uint))
+        return false;
+
+    /* read offsets, lengths and counts as sizes, the view needs a length */
+    std::size_t szcomponent = acc.componenttype == gltf_ubyte ? 1 : acc.componenttype == gltf_ushort ? 2 : 4;
+    std::size_t szelement = szcomponent * ncomponents;
+    std::size_t viewoffset, viewlength, offset;
+    if (!jsonsize(jsonget(view, "byteOffset"), 0.0, viewoffset) || !jsonsize(jsonget(view, "byteLength"), -1.0, viewlength) || !jsonsize(jsonget(accessor, "byteOffset"), 0.0, offset)
+        || !jsonsize(jsonget(accessor, "count"), 0.0, acc.count) || !jsonsize(jsonget(view, "byteStride"), static_cast<double>(szelement), acc.stride) || acc.stride < szelement)
+        return false;
+
+    /* bound check view against binary chunk and the accessor's range against the view, subtracting so nothing overflows */
+    if (viewoffset > szbin || viewlength > szbin - viewoffset || offset > viewlength)
+        return false;
+    std::size_t available = viewlength - offset;
+    if (acc.count > 0 && (szelement > available || acc.count - 1 > (available - szelement) / acc.stride))
+        return false;
+    acc.data = bin + viewoffset + offset;
+    return true;
+
+}
+
+static float gltffloat(const gltfaccessor& acc, std::size_t i, int c) {
+
+    /* read float component, unaligned strides are legal */
+    float value;
+    std::memcpy(&value, acc.data + i * acc.stride + c * sizeof(float), sizeof(float));
+    return value;
+
+}
+
+static GLuint gltfindex(const gltfaccessor& acc, std::size_t i) {
+
+    /* read index of any width */
+    const unsigned char* p = acc.data + i * acc.stride;
+    if (acc.componenttype == gltf_ubyte)
+        return *p;
+    if (acc.componenttype == gltf_ushort) {
+        std::uint16_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    std::uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+
+}
+
+static std::string gltftexname(const jsonvalue& root, const jsonvalue* texinfo) {
+
+    /* texture names are image uris, embedded images are named like assimp does */
+    if (texinfo == nullptr)
+        return std::string();
+    const jsonvalue* texture = jsonat(jsonget(&root, "textures"), static_cast<long>(jsonnumber(jsonget(texinfo, "index"), -1.0)));
+    long source = static_cast<long>(jsonnumber(jsonget(texture, "source"), -1.0));
+    const jsonvalue* uri = jsonget(jsonat(jsonget(&root, "images"), source), "uri");
+    if (uri != nullptr && uri->type == json_string)
+        return uri->string;
+    return source < 0 ? std::string() : "*" + std::to_string(source);
+
+}
+
+static void genmeshframes(meshdata& md, const std::vector<GLuint>& indices, bool hasnormals, bool hastangents) {
+
+    /* accumulate area weighted face normals and uv aligned tangents */
+    std::vector<glm::vec3> normals(md.vertices.size(), glm::vec3(0.0f)), tangents(md.vertices.size(), glm::vec3(0.0f)), bitangents(md.vertices.size(), glm::vec3(0.0f));
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const attribs& a0 = md.vertices[indices[i]];
+        const attribs& a1 = md.vertices[indices[i + 1]];
+        const attribs& a2 = md.vertices[indices[i + 2]];
+        glm::vec3 e1(a1.pos[0] - a0.pos[0], a1.pos[1] - a0.pos[1], a1.pos[2] - a0.pos[2]);
+        glm::vec3 e2(a2.pos[0] - a0.pos[0], a2.pos[1] - a0.pos[1], a2.pos[2] - a0.pos[2]);
+        float du1 = a1.uv[0] - a0.uv[0], dv1 = a1.uv[1] - a0.uv[1], du2 = a2.uv[0] - a0.uv[0], dv2 = a2.uv[1] - a0.uv[1];
+        float det = du1 * dv2 - du2 * dv1;
+        glm::vec3 n = glm::cross(e1, e2);
+        glm::vec3 t = std::fabs(det) > 1e-12f ? (e1 * dv2 - e2 * dv1) / det : glm::vec3(0.0f);
+        glm::vec3 b = std::fabs(det) > 1e-12f ? (e2 * du1 - e1 * du2) / det : glm::vec3(0.0f);
+        for (int k = 0; k < 3; ++k) {
+            normals[indices[i + k]] += n;
+            tangents[indices[i + k]] += t;
+            bitangents[indices[i + k]] += b;
+        }
+    }
+
+    /* orthonormalize per vertex, keeping handedness of the uv mapping */
+    for (std::size_t v = 0; v < md.vertices.size(); ++v) {
+        attribs& a = md.vertices[v];
+        glm::vec3 n = hasnormals ? glm::vec3(a.norm[0], a.norm[1], a.norm[2]) : normals[v];
+        n = glm::dot(n, n) > 0.0f ? glm::normalize(n) : glm::vec3(0.0f, 1.0f, 0.0f);
+        for (int c = 0; c < 3; ++c)
+            a.norm[c] = n[c];
+        if (hastangents)
+            continue;
+        glm::vec3 t = tangents[v] - n * glm::dot(n, tangents[v]);
+        if (glm::dot(t, t) < 1e-12f)
+            t = glm::cross(n, std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+        t = glm::normalize(t);
+        glm::vec3 b = glm::cross(n, t) * (glm::dot(glm::cross(n, t), bitangents[v]) < 0.0f ? -1.0f : 1.0f);
+        for (int c = 0; c < 3; ++c) {
+            a.tng[c] = t[c];
+            a.bitng[c] = b[c];
+        }
+    }
+
+}
+
+static bool importglb(const std::string& filepath, std::vector<meshdata>& meshes, std::vector<scenenode>& nodes) {
+
+    /* map file and find json and binary chunks */
+    mappedfile mf;
+    if (!mapfile(filepath, mf))
+        return false;
+    std::uint32_t header[5];
+    if (mf.size < sizeof(header)) {
+        unmapfile(mf);
+        return false;
+    }
+    std::memcpy(header, mf.data, sizeof(header));
+    std::size_t szjson = header[3], binoffset = sizeof(header) + szjson + 2 * sizeof(std::uint32_t);
+    if (header[0] != glb_magic || header[1] != glb_version || header[4] != glb_chunk_json || sizeof(header) + szjson > mf.size) {
+        unmapfile(mf);
+        return false;
+    }
+    std::uint32_t binchunk[2] = { 0, 0 };
+    if (binoffset <= mf.size)
+        std::memcpy(binchunk, mf.data + binoffset - sizeof(binchunk), sizeof(binchunk));
+    const unsigned char* bin = mf.data + binoffset;
+    std::size_t szbin = binoffset <= mf.size && binchunk[1] == glb_chunk_bin ? std::min<std::size_t>(binchunk[0], mf.size - binoffset) : 0;
+
+    /* parse json chunk */
+    jsonvalue root;
+    const char* p = reinterpret_cast<const char*>(mf.data + sizeof(header));
+    if (!jsonparse(p, p + szjson, root)) {
+        unmapfile(mf);
+        return false;
+    }
+
+    /* convert every triangle primitive, remembering which meshdatas each gltf mesh became */
+    std::vector<meshdata> outmeshes;
+    std::vector<std::vector<std::uint32_t>> meshprims;
+    const jsonvalue* gltfmeshes = jsonget(&root, "meshes");
+    for (std::size_t m = 0; gltfmeshes != nullptr && m < gltfmeshes->items.size(); ++m) {
+        meshprims.emplace_back();
+        const jsonvalue* prims = jsonget(&gltfmeshes->items[m], "primitives");
+        for (std::size_t i = 0; prims != nullptr && i < prims->items.size(); ++i) {
+            const jsonvalue* prim = &prims->items[i];
+            const jsonvalue* attributes = jsonget(prim, "attributes");
+
+            /* view attribute streams, anything unusual leaves the file to assimp */
+            gltfaccessor positions, normals, tangents, uvs, indices;
+            bool hasnormals = jsonget(attributes, "NORMAL") != nullptr, hastangents = jsonget(attributes, "TANGENT") != nullptr, hasuvs = jsonget(attributes, "TEXCOORD_0") != nullptr, hasindices = jsonget(prim, "indices") != nullptr;
+            if (jsonnumber(jsonget(prim, "mode"), gltf_triangles) != gltf_triangles
+                || !gltfaccess(root, bin, szbin, static_cast<long>(jsonnumber(jsonget(attributes, "POSITION"), -1.0)), gltf_float, 3, positions)
+                || (hasnormals && (!gltfaccess(root, bin, szbin, static_cast<long>(jsonnumber(jsonget(attributes, "NORMAL"), -1.0)), gltf_float, 3, normals) || normals.count != positions.count))
+                || (hastangents && (!gltfaccess(root, bin, szbin, static_cast<long>(jsonnumber(jsonget(attributes, "TANGENT"), -1.0)), gltf_float, 4, tangents) || tangents.count != positions.count))
+                || (hasuvs && (!gltfaccess(root, bin, szbin, static_cast<long>(jsonnumber(jsonget(attributes, "TEXCOORD_0"), -1.0)), gltf_float, 2, uvs) || uvs.count != positions.count))
+                || (hasindices && !gltfaccess(root, bin, szbin, static_cast<long>(jsonnumber(jsonget(prim, "indices"), -1.0)), 0, 1, indices))) {
+                unmapfile(mf);
+                return false;
+            }
+
+            /* build vertices straight from the mapped streams, v flips to match flipped image loading */
+            meshdata md;
+            md.vertices.resize(positions.count);
+            for (std::size_t v = 0; v < positions.count; ++v) {
+                attribs& a = md.vertices[v];
+                for (int c = 0; c < 3; ++c) {
+                    a.pos[c] = gltffloat(positions, v, c);
+                    a.norm[c] = hasnormals ? gltffloat(normals, v, c) : 0.0f;
+                }
+                a.uv[0] = hasuvs ? gltffloat(uvs, v, 0) : 0.0f;
+                a.uv[1] = hasuvs ? 1.0f - gltffloat(uvs, v, 1) : 0.0f;
+                if (hastangents) {
+                    glm::vec3 n(a.norm[0], a.norm[1], a.norm[2]), t(gltffloat(tangents, v, 0), gltffloat(tangents, v, 1), gltffloat(tangents, v, 2));
+                    glm::vec3 b = glm::cross(n, t) * -gltffloat(tangents, v, 3);
+                    for (int c = 0; c < 3; ++c) {
+                        a.tng[c] = t[c];
+                        a.bitng[c] = b[c];
+                    }
+                }
+            }
+
+            /* read indices, non indexed primitives draw vertices in order */
+            std::vector<GLuint> triangles(hasindices ? indices.count : positions.count);
+            for (std::size_t j = 0; j < triangles.size(); ++j) {
+                triangles[j] = hasindices ? gltfindex(indices, j) : static_cast<GLuint>(j);
+                if (triangles[j] >= positions.count) {
+                    unmapfile(mf);
+                    return false;
+                }
+            }
+            triangles.resize(triangles.size() / 3 * 3);
+            if (!hasnormals || !hastangents)
+                genmeshframes(md, triangles, hasnormals, hastangents);
+            md.indextype = md.vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+            md.indices.resize(triangles.size() * indexsize(md.indextype));
+            for (std::size_t j = 0; j < triangles.size(); ++j)
+                if (md.indextype == GL_UNSIGNED_SHORT)
+                    reinterpret_cast<GLushort*>(md.indices.data())[j] = static_cast<GLushort>(triangles[j]);
+                else
+                    reinterpret_cast<GLuint*>(md.indices.data())[j] = triangles[j];
+
+            /* reorder for vertex cache, overdraw and vertex fetch */
+            optimizemesh(md);
+
+            /* base color and normal textures, gltf has no specular map */
+            const jsonvalue* material = jsonat(jsonget(&root, "materials"), static_cast<long>(jsonnumber(jsonget(prim, "material"), -1.0)));
+            md.texnames[texslot_diff] = gltftexname(root, jsonget(jsonget(material, "pbrMetallicRoughness"), "baseColorTexture"));
+            md.texnames[texslot_norm] = gltftexname(root, jsonget(material, "normalTexture"));
+
+            meshprims.back().push_back(static_cast<std::uint32_t>(outmeshes.size()));
+            outmeshes.push_back(md);
+        }
+    }
+    unmapfile(mf);
+
+    /* start from default scene roots, or from every node without parent */
+    const jsonvalue* gltfnodes = jsonget(&root, "nodes");
+    std::size_t ngltfnodes = gltfnodes != nullptr ? gltfnodes->items.size() : 0;
+    std::vector<long> roots;
+    const jsonvalue* scene = jsonat(jsonget(&root, "scenes"), static_cast<long>(jsonnumber(jsonget(&root, "scene"), 0.0)));
+    if (scene != nullptr) {
+        const jsonvalue* scenenodes = jsonget(scene, "nodes");
+        for (std::size_t i = 0; scenenodes != nullptr && i < scenenodes->items.size(); ++i)
+            roots.push_back(static_cast<long>(jsonnumber(&scenenodes->items[i], -1.0)));
+    } else {
+        std::vector<bool> child(ngltfnodes, false);
+        for (std::size_t i = 0; i < ngltfnodes; ++i) {
+            const jsonvalue* children = jsonget(&gltfnodes->items[i], "children");
+            for (std::size_t j = 0; children != nullptr && j < children->items.size(); ++j) {
+                long c = static_cast<long>(jsonnumber(&children->items[j], -1.0));
+                if (c >= 0 && static_cast<std::size_t>(c) < ngltfnodes)
+                    child[c] = true;
+            }
+        }
+        for (std::size_t i = 0; i < ngltfnodes; ++i)
+            if (!child[i])
+                roots.push_back(static_cast<long>(i));
+    }
+
+    /* flatten node tree with parents before children, bailing out on cycles */
+    std::vector<scenenode> outnodes;
+    std::vector<std::pair<long, int>> stack;
+    for (std::vector<long>::reverse_iterator it = roots.rbegin(); it != roots.rend(); ++it)
+        stack.push_back(std::make_pair(*it, -1));
+    while (!stack.empty()) {
+        const jsonvalue* gltfnode = jsonat(gltfnodes, stack.back().first);
+        scenenode node;
+        node.parent = stack.back().second;
+        stack.pop_back();
+        if (gltfnode == nullptr || outnodes.size() >= ngltfnodes)
+            return false;
+
+        /* local transform from matrix or translation, rotation and scale */
+        const jsonvalue* matrix = jsonget(gltfnode, "matrix");
+        if (matrix != nullptr && matrix->items.size() == 16)
+            for (int c = 0; c < 16; ++c)
+                node.local[c / 4][c % 4] = static_cast<float>(jsonnumber(&matrix->items[c], 0.0));
+        else {
+            const jsonvalue* t = jsonget(gltfnode, "translation");
+            const jsonvalue* r = jsonget(gltfnode, "rotation");
+            const jsonvalue* s = jsonget(gltfnode, "scale");
+            glm::vec3 translation(0.0f), scale(1.0f);
+            glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+            for (int c = 0; c < 3; ++c) {
+                translation[c] = static_cast<float>(jsonnumber(jsonat(t, c), 0.0));
+                scale[c] = static_cast<float>(jsonnumber(jsonat(s, c), 1.0));
+            }
+            if (r != nullptr && r->items.size() == 4)
+                rotation = glm::quat(static_cast<float>(jsonnumber(jsonat(r, 3), 1.0)), static_cast<float>(jsonnumber(jsonat(r, 0), 0.0)), static_cast<float>(jsonnumber(jsonat(r, 1), 0.0)), static_cast<float>(jsonnumber(jsonat(r, 2), 0.0)));
+            node.local = glm::translate(translation) * glm::toMat4(rotation) * glm::scale(scale);
+        }
+
+        /* meshes and children */
+        long mesh = static_cast<long>(jsonnumber(jsonget(gltfnode, "mesh"), -1.0));
+        if (mesh >= 0 && static_cast<std::size_t>(mesh) < meshprims.size())
+            node.meshes = meshprims[mesh];
+        const jsonvalue* children = jsonget(gltfnode, "children");
+        for (std::size_t j = children != nullptr ? children->items.size() : 0; j > 0; --j)
+            stack.push_back(std::make_pair(static_cast<long>(jsonnumber(&children->items[j - 1], -1.0)), static_cast<int>(outnodes.size())));
+        outnodes.push_back(node);
+    }
+
+    /* files without nodes still show their meshes */
+    if (outnodes.empty()) {
+        scenenode node;
+        node.local = glm::mat4(1.0f);
+        node.parent = -1;
+        for (std::size_t i = 0; i < outmeshes.size(); ++i)
+            node.meshes.push_back(static_cast<std::uint32_t>(i));
+        outnodes.push_back(node);
+    }
+    meshes.swap(outmeshes);
+    nodes.swap(outnodes);
+    return true;
+
+}
+
+static void writemeshcache(const std::string& cachepath, std::uint64_t hash, unsigned int importflags, const std::vector<meshdata>& meshes, const std::vector<scenenode>& nodes) {
+
+    /* build node table */
+    std::vector<meshcachenode> nodeentries(nodes.size());
+    std::vector<std::uint32_t> nodemeshes;
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        std::memcpy(nodeentries[i].local, glm::value_ptr(nodes[i].local), sizeof(nodeentries[i].local));
+        nodeentries[i].parent = nodes[i].parent;
+        nodeentries[i].firstmesh = static_cast<std::uint32_t>(nodemeshes.size());
+        nodeentries[i].nmeshes = static_cast<std::uint32_t>(nodes[i].meshes.size());
+        nodeentries[i].reserved = 0;
+        nodemeshes.insert(nodemeshes.end(), nodes[i].meshes.begin(), nodes[i].meshes.end());
+    }
+
+    /* build string table */
+    std::vector<meshcacheentry> entries(meshes.size());
+    std::string strings;
+    for (std::size_t i = 0; i < meshes.size(); ++i)
+        for (int slot = 0; slot < ntexslots; ++slot) {
+            if (meshes[i].texnames[slot].empty())
+                entries[i].texnames[slot] = meshcache_notex;
+            else {
+                entries[i].texnames[slot] = static_cast<std::uint32_t>(strings.size());
+                strings += meshes[i].texnames[slot];
+                strings += '\0';
+            }
+        }
+
+    /* lay out aligned blobs after header, tables and strings */
+    #define meshcache_alignup(x) (((x) + meshcache_align - 1) / meshcache_align * meshcache_align)
+    std::uint64_t offset = meshcache_alignup(sizeof(meshcacheheader) + entries.size() * sizeof(meshcacheentry) + nodeentries.size() * sizeof(meshcachenode) + nodemeshes.size() * sizeof(std::uint32_t) + strings.size());
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+        entries[i].nvertices = static_cast<std::uint32_t>(meshes[i].vertices.size());
+        entries[i].nindices = static_cast<std::uint32_t>(meshes[i].indices.size() / indexsize(meshes[i].indextype));
+        entries[i].indextype = meshes[i].indextype;
+        entries[i].lods = meshes[i].lods;
+        entries[i].vertexoffset = offset;
+        offset = meshcache_alignup(offset + meshes[i].vertices.size() * sizeof(attribs));
+        entries[i].indexoffset = offset;
+        offset = meshcache_alignup(offset + meshes[i].indices.size());
+    }
+
+    /* open stream, quietly leaving the cache out if it cannot be written */
+    std::ofstream stream(cachepath, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!stream.good()) {
+        std::cerr << "cannot write mesh cache " << cachepath << std::endl;
+        return;
+    }
+
+    /* write header, tables and strings */
+    meshcacheheader header = { meshcache_magic, meshcache_version, hash, scene_rvc_flags, importflags, static_cast<std::uint32_t>(meshes.size()), static_cast<std::uint32_t>(nodes.size()), static_cast<std::uint32_t>(nodemeshes.size()), static_cast<std::uint32_t>(strings.size()) };
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(meshcacheentry)));
+    stream.write(reinterpret_cast<const char*>(nodeentries.data()), static_cast<std::streamsize>(nodeentries.size() * sizeof(meshcachenode)));
+    stream.write(reinterpret_cast<const char*>(nodemeshes.data()), static_cast<std::streamsize>(nodemeshes.size() * sizeof(std::uint32_t)));
+    stream.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+
+    /* write blobs at their offsets, zero padding in between */
+    static const char padding[meshcache_align] = { 0 };
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+        stream.write(padding, static_cast<std::streamsize>(entries[i].vertexoffset - stream.tellp()));
+        stream.write(reinterpret_cast<const char*>(meshes[i].vertices.data()), static_cast<std::streamsize>(meshes[i].vertices.size() * sizeof(attribs)));
+        stream.write(padding, static_cast<std::streamsize>(entries[i].indexoffset - stream.tellp()));
+        stream.write(reinterpret_cast<const char*>(meshes[i].indices.data()), static_cast<std::streamsize>(meshes[i].indices.size()));
+    }
+    stream.close();
+
+}
+
+static bool meshcachefits(std::size_t size, std::uint64_t offset, std::uint64_t count, std::size_t stride) {
+
+    /* count elements of stride at offset lie within size, written so that nothing wraps */
+    return offset <= size && count <= (size - offset) / stride;
+
+}
+
+static bool loadmeshcache(const std::string& cachepath, std::uint64_t hash, unsigned int importflags, mappedfile& mf, std::vector<meshview>& views, std::vector<scenenode>& nodes) {
+
+    /* map cache and validate its key */
+    if (!mapfile(cachepath, mf))
+        return false;
+    const meshcacheheader* header = reinterpret_cast<const meshcacheheader*>(mf.data);
+    if (mf.size < sizeof(meshcacheheader) || header->magic != meshcache_magic || header->version != meshcache_version || header->hash != hash || header->rvcflags != scene_rvc_flags || header->importflags != importflags) {
+        unmapfile(mf);
+        return false;
+    }
+
+    /* tables and strings follow the header one after another, each must fit in what the file has left */
+    std::uint64_t tablecounts[] = { header->nmeshes, header->nnodes, header->nnodemeshes, header->szstrings };
+    std::size_t tablestrides[] = { sizeof(meshcacheentry), sizeof(meshcachenode), sizeof(std::uint32_t), 1 };
+    std::uint64_t tableoffset = sizeof(meshcacheheader);
+    for (int t = 0; t < 4; ++t) {
+        if (!meshcachefits(mf.size, tableoffset, tablecounts[t], tablestrides[t])) {
+            unmapfile(mf);
+            return false;
+        }
+        tableoffset += tablecounts[t] * tablestrides[t];
+    }
+
+    /* copy nodes out, they are small and the scene keeps them, parents are -1 for roots or come before their children */
+    const meshcacheentry* entries = reinterpret_cast<const meshcacheentry*>(mf.data + sizeof(meshcacheheader));
+    const meshcachenode* nodeentries = reinterpret_cast<const meshcachenode*>(entries + header->nmeshes);
+    const std::uint32_t* nodemeshes = reinterpret_cast<const std::uint32_t*>(nodeentries + header->nnodes);
+    const char* strings = reinterpret_cast<const char*>(nodemeshes + header->nnodemeshes);
+    nodes.resize(header->nnodes);
+    for (std::uint32_t i = 0; i < header->nnodes; ++i) {
+        const meshcachenode& entry = nodeentries[i];
+        if (entry.parent < -1 || entry.parent >= static_cast<std::int32_t>(i) || entry.firstmesh > header->nnodemeshes || entry.nmeshes > header->nnodemeshes - entry.firstmesh) {
+            nodes.clear();
+            unmapfile(mf);
+            return false;
+        }
+        std::memcpy(glm::value_ptr(nodes[i].local), entry.local, sizeof(entry.local));
+        nodes[i].parent = entry.parent;
+        nodes[i].meshes.assign(nodemeshes + entry.firstmesh, nodemeshes + entry.firstmesh + entry.nmeshes);
+    }
+
+    /* point views straight into the mapping */
+    views.resize(header->nmeshes);
+    for (std::uint32_t i = 0; i < header->nmeshes; ++i) {
+        const meshcacheentry& entry = entries[i];
+        if ((entry.indextype != GL_UNSIGNED_SHORT && entry.indextype != GL_UNSIGNED_INT) || entry.lods.nlods == 0 || entry.lods.nlods > lod_maxlevels || entry.lods.offsets[0] != 0 || entry.lods.offsets[entry.lods.nlods] != entry.nindices
+            || !meshcachefits(mf.size, entry.vertexoffset, entry.nvertices, sizeof(attribs)) || !meshcachefits(mf.size, entry.indexoffset, entry.nindices, indexsize(entry.indextype))) {
+            views.clear();
+            unmapfile(mf);
+            return false;
+        }
+
+        /* lod ranges must follow one another, draws and clusters take their counts from them */
+        for (std::uint32_t l = 0; l < entry.lods.nlods; ++l)
+            if (entry.lods.offsets[l + 1] < entry.lods.offsets[l]) {
+                views.clear();
+                unmapfile(mf);
+                return false;
+            }
+
+        /* indices must address the mesh's own vertices, clusters read them on the cpu */
+        const unsigned char* indices = mf.data + entry.indexoffset;
+        for (std::uint32_t n = 0; n < entry.nindices; ++n)
+            if ((entry.indextype == GL_UNSIGNED_SHORT ? reinterpret_cast<const GLushort*>(indices)[n] : reinterpret_cast<const GLuint*>(indices)[n]) >= entry.nvertices) {
+                views.clear();
+                unmapfile(mf);
+                return false;
+            }
+
+        /* texture names must start within the string table and end there */
+        for (int slot = 0; slot < ntexslots; ++slot)
+            if (entry.texnames[slot] != meshcache_notex && (entry.texnames[slot] >= header->szstrings || std::memchr(strings + entry.texnames[slot], 0, header->szstrings - entry.texnames[slot]) == nullptr)) {
+                views.clear();
+                unmapfile(mf);
+                return false;
+            }
+        views[i].vertices = reinterpret_cast<const attribs*>(mf.data + entry.vertexoffset);
+        views[i].nvertices = entry.nvertices;
+        views[i].indices = mf.data + entry.indexoffset;
+        views[i].nindices = entry.nindices;
+        views[i].indextype = entry.indextype;
+        views[i].lods = entry.lods;
+        for (int slot = 0; slot < ntexslots; ++slot)
+            views[i].texnames[slot] = entry.texnames[slot] == meshcache_notex ? std::string() : std::string(strings + entry.texnames[slot]);
+    }
+    return true;
+
+}
+
+/* packed vertices of one mesh with their dequantization */
+typedef struct {
+    std::vector<packedattribs> vertices;
+    glm::vec3 posoffset, posscale;
+} packedmesh;
+
+static void packmesh(const meshview& mv, packedmesh& pm) {
+
+    /* find mesh bounds, positions are quantized within them */
+    glm::vec3 lo(0.0f), hi(0.0f);
+    for (std::uint32_t i = 0; i < mv.nvertices; ++i) {
+        glm::vec3 pos(mv.vertices[i].pos[0], mv.vertices[i].pos[1], mv.vertices[i].pos[2]);
+        lo = i == 0 ? pos : glm::min(lo, pos);
+        hi = i == 0 ? pos : glm::max(hi, pos);
+    }
+    pm.posoffset = lo;
+    pm.posscale = glm::max(hi - lo, glm::vec3(1e-6f));
+
+    /* pack all vertices */
+    pm.vertices.resize(mv.nvertices);
+    for (std::uint32_t i = 0; i < mv.nvertices; ++i) {
+        const attribs& a = mv.vertices[i];
+        packedattribs& pa = pm.vertices[i];
+
+        /* quantize position and uv */
+        for (int c = 0; c < 3; ++c)
+            pa.pos[c] = static_cast<GLushort>(std::lround(glm::clamp((a.pos[c] - pm.posoffset[c]) / pm.posscale[c], 0.0f, 1.0f) * 65535.0f));
+        pa.pos[3] = 0;
+        pa.uv[0] = glm::packHalf1x16(a.uv[0]);
+        pa.uv[1] = glm::packHalf1x16(a.uv[1]);
+
+        /* orthonormalize tangent against normal, bitangent only keeps handedness */
+        glm::vec3 n = glm::normalize(glm::vec3(a.norm[0], a.norm[1], a.norm[2]));
+        glm::vec3 t(a.tng[0], a.tng[1], a.tng[2]), b(a.bitng[0], a.bitng[1], a.bitng[2]);
+        t -= n * glm::dot(n, t);
+        if (glm::dot(t, t) < 1e-12f)
+            t = glm::cross(n, std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+        t = glm::normalize(t);
+        bool reflected = glm::dot(glm::cross(n, t), b) < 0.0f;
+
+        /* frame as quaternion with w kept positive and above snorm16 precision, its sign then carries handedness */
+        glm::quat q = glm::quat_cast(glm::mat3(t, glm::cross(n, t), n));
+        if (q.w < 0.0f)
+            q = -q;
+        const float bias = 1.0f / 32767.0f;
+        if (q.w < bias) {
+            float norm = std::sqrt(1.0f - bias * bias);
+            q.x *= norm;
+            q.y *= norm;
+            q.z *= norm;
+            q.w = bias;
+        }
+        if (reflected)
+            q = -q;
+        float qc[4] = { q.x, q.y, q.z, q.w };
+        for (int c = 0; c < 4; ++c)
+            pa.qtangent[c] = static_cast<GLshort>(std::lround(glm::clamp(qc[c], -1.0f, 1.0f) * 32767.0f));
+    }
+
+}
+
+/* meshes of one batch, grouped before upload */
+typedef struct {
+    std::vector<std::size_t> meshes;
+    GLenum indextype;
+    std::uint32_t features;
+} batchplan;
+
+static std::uint32_t materialfeatures(const meshview& mv, const std::unordered_map<std::string, std::string>& texmap) {
+
+    /* slots the material fills, and whether any of them pages from tiles */
+    std::uint32_t features = 0;
+    for (int slot = 0; slot < ntexslots; ++slot) {
+        if (mv.texnames[slot].empty())
+            continue;
+        assert(texmap.count(mv.texnames[slot]) > 0);
+        const std::string& path = texmap.at(mv.texnames[slot]);
+        features |= 1 << slot;
+        if (path.size() > 5 && path.compare(path.size() - 5, 5, ".vtex") == 0)
+            features |= phong_feature_virtual;
+    }
+    return features;
+
+}
+
+static void planbatches(const std::vector<meshview>& views, const std::unordered_map<std::string, std::string>& texmap, std::vector<batchplan>& plans) {
+
+    /* group meshes by index type and material features, vertex format is the same for the whole scene */
+    for (std::size_t i = 0; i < views.size(); ++i) {
+        std::uint32_t features = materialfeatures(views[i], texmap);
+        std::size_t p = 0;
+        while (p < plans.size() && (plans[p].indextype != views[i].indextype || plans[p].features != features))
+            ++p;
+        if (p == plans.size()) {
+            plans.emplace_back();
+            plans[p].indextype = views[i].indextype;
+            plans[p].features = features;
+        }
+        plans[p].meshes.push_back(i);
+    }
+
+}
+
+/* cluster splitting, meshes below the minimum are only culled as a whole */
+#define cluster_triangles 128
+#define cluster_minmeshtriangles 8192
+
+static void genclusters(const meshview& mv, std::vector<clusterdata>& clusters) {
+
+    /* full detail only, coarser levels are picked when meshes are small on screen anyway */
+    std::uint32_t nindices = mv.lods.offsets[1];
+    if (nindices / 3 < cluster_minmeshtriangles)
+        return;
+    for (std::uint32_t first = 0; first < nindices; first += 3 * cluster_triangles) {
+        std::uint32_t count = std::min<std::uint32_t>(3 * cluster_triangles, nindices - first);
+
+        /* gather positions and triangle normals */
+        std::vector<glm::vec3> positions(count), normals;
+        for (std::uint32_t i = 0; i < count; ++i) {
+            GLuint index = mv.indextype == GL_UNSIGNED_SHORT ? static_cast<const GLushort*>(mv.indices)[first + i] : static_cast<const GLuint*>(mv.indices)[first + i];
+            positions[i] = glm::vec3(mv.vertices[index].pos[0], mv.vertices[index].pos[1], mv.vertices[index].pos[2]);
+        }
+        glm::vec3 lo = positions[0], hi = positions[0], axis(0.0f);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            lo = glm::min(lo, positions[i]);
+            hi = glm::max(hi, positions[i]);
+        }
+        for (std::uint32_t i = 0; i + 2 < count; i += 3) {
+            glm::vec3 n = glm::cross(positions[i + 1] - positions[i], positions[i + 2] - positions[i]);
+            if (glm::dot(n, n) <= 0.0f)
+                continue;
+            normals.push_back(glm::normalize(n));
+            axis += normals.back();
+        }
+
+        /* bounding sphere around box center */
+        glm::vec3 center = (lo + hi) * 0.5f;
+        float radius = 0.0f;
+        for (const glm::vec3& pos : positions)
+            radius = std::max(radius, glm::length(pos - center));
+
+        /* normal cone, wide cones get a cutoff no view can pass */
+        float mindot = 1.0f;
+        axis = glm::dot(axis, axis) > 0.0f ? glm::normalize(axis) : glm::vec3(0.0f, 1.0f, 0.0f);
+        for (const glm::vec3& n : normals)
+            mindot = std::min(mindot, glm::dot(n, axis));
+        float cutoff = normals.empty() || mindot <= 0.1f ? 1.0f : std::sqrt(1.0f - mindot * mindot);
+
+        clusterdata cluster = { { center.x, center.y, center.z, radius }, { axis.x, axis.y, axis.z, cutoff }, first, count, { 0, 0 } };
+        clusters.push_back(cluster);
+    }
+
+}
+
+static void uploadbatch(const std::vector<meshview>& views, const std::vector<packedmesh>& packed, const std::unordered_map<std::string, GLint>& texids, const std::vector<std::vector<GLuint>>& meshnodes, const std::vector<std::vector<clusterdata>>& meshclusters, const batchplan& plan, drawbatch& b) {
+
+    /* lay out draws back to back, indices stay mesh relative through base vertex, instances through base instance */
+    std::size_t szvertex = packed.empty() ? sizeof(attribs) : sizeof(packedattribs), szindex = indexsize(plan.indextype);
+    std::size_t nvertices = 0, nindices = 0;
+    std::vector<drawdata> draws(plan.meshes.size());
+    std::vector<instancedata> instances;
+    std::vector<clusterdata> clusters;
+    b.packed = !packed.empty();
+    b.indextype = plan.indextype;
+    b.features = plan.features | (b.packed ? phong_feature_packed : 0);
+    b.commands.resize(plan.meshes.size());
+    b.lods.resize(plan.meshes.size());
+    b.clusterfirst.resize(plan.meshes.size());
+    b.clustercount.resize(plan.meshes.size());
+    for (std::size_t d = 0; d < plan.meshes.size(); ++d) {
+        const meshview& mv = views[plan.meshes[d]];
+        const std::vector<GLuint>& nodes = meshnodes[plan.meshes[d]];
+        drawcommand cmd = { mv.lods.offsets[1], static_cast<GLuint>(nodes.size()), static_cast<GLuint>(nindices), static_cast<GLint>(nvertices), static_cast<GLuint>(instances.size()) };
+        b.commands[d] = cmd;
+        b.lods[d] = mv.lods;
+        glm::vec3 posoffset = b.packed ? packed[plan.meshes[d]].posoffset : glm::vec3(0.0f);
+        glm::vec3 posscale = b.packed ? packed[plan.meshes[d]].posscale : glm::vec3(1.0f);
+        for (int c = 0; c < 3; ++c) {
+            draws[d].posoffset[c] = posoffset[c];
+            draws[d].posscale[c] = posscale[c];
+        }
+        draws[d].posoffset[3] = draws[d].posscale[3] = 0.0f;
+        for (int slot = 0; slot < ntexslots; ++slot) {
+            assert(mv.texnames[slot].empty() || texids.count(mv.texnames[slot]) > 0);
+            draws[d].textures[slot] = mv.texnames[slot].empty() ? -1 : texids.at(mv.texnames[slot]);
+        }
+        draws[d].textures[3] = -1;
+        for (GLuint node : nodes)
+            instances.push_back({ static_cast<GLuint>(d), node });
+        b.clusterfirst[d] = static_cast<GLuint>(clusters.size());
+        b.clustercount[d] = static_cast<GLuint>(meshclusters[plan.meshes[d]].size());
+        for (clusterdata cluster : meshclusters[plan.meshes[d]]) {
+            cluster.firstindex += cmd.firstindex;
+            clusters.push_back(cluster);
+        }
+        nvertices += mv.nvertices;
+        nindices += mv.nindices;
+    }
+
+    /* gen buffers, they are shared between contexts unlike vaos */
+    glGenBuffers(1, &b.vbo);
+    glGenBuffers(1, &b.ibo);
+    glGenBuffers(1, &b.instances);
+    glGenBuffers(1, &b.draws);
+    glGenBuffers(1, &b.indirect);
+
+    /* fill shared vertex and index buffers through copy target, no vao needs to be bound */
+    glBindBuffer(GL_COPY_WRITE_BUFFER, b.vbo);
+    glBufferData(GL_COPY_WRITE_BUFFER, nvertices * szvertex, nullptr, GL_STATIC_DRAW);
+    for (std::size_t d = 0; d < plan.meshes.size(); ++d) {
+        const void* vertices = b.packed ? static_cast<const void*>(packed[plan.meshes[d]].vertices.data()) : static_cast<const void*>(views[plan.meshes[d]].vertices);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, b.commands[d].basevertex * szvertex, views[plan.meshes[d]].nvertices * szvertex, vertices);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, b.ibo);
+    glBufferData(GL_COPY_WRITE_BUFFER, nindices * szindex, nullptr, GL_STATIC_DRAW);
+    for (std::size_t d = 0; d < plan.meshes.size(); ++d)
+        glBufferSubData(GL_COPY_WRITE_BUFFER, b.commands[d].firstindex * szindex, views[plan.meshes[d]].nindices * szindex, views[plan.meshes[d]].indices);
+
+    /* fill instances, per draw data and commands */
+    glBindBuffer(GL_COPY_WRITE_BUFFER, b.instances);
+    glBufferData(GL_COPY_WRITE_BUFFER, instances.size() * sizeof(instancedata), instances.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, b.draws);
+    glBufferData(GL_COPY_WRITE_BUFFER, draws.size() * sizeof(drawdata), draws.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, b.indirect);
+    glBufferData(GL_COPY_WRITE_BUFFER, b.commands.size() * sizeof(drawcommand), b.commands.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    b.instancelist = instances;
+
+    /* clusters of large meshes, their jobs, commands and instances are streamed every frame */
+    b.clusters = b.clusterjobs = b.clustercommands = b.clusterinstances = 0;
+    if (clusters.empty())
+        return;
+    glGenBuffers(1, &b.clusters);
+    glGenBuffers(1, &b.clusterjobs);
+    glGenBuffers(1, &b.clustercommands);
+    glGenBuffers(1, &b.clusterinstances);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, b.clusters);
+    glBufferData(GL_COPY_WRITE_BUFFER, clusters.size() * sizeof(clusterdata), clusters.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+}
+
+static void genbatchvao(drawbatch& b) {
+
+    /* gen and bind vao, attach uploaded vbo & ibo */
+    glGenVertexArrays(1, &(b.vao));
+    glBindVertexArray(b.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, b.vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, b.ibo);
+
+    /* map input attributes, packed vertices carry a qtangent in place of normal, tangent and bitangent */
+    if (b.packed) {
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(0, sz_pos_attrib, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(packedattribs), reinterpret_cast<const void*>(offsetof(packedattribs, pos)));
+        glVertexAttribPointer(1, sz_uv_attrib, GL_HALF_FLOAT, GL_FALSE, sizeof(packedattribs), reinterpret_cast<const void*>(offsetof(packedattribs, uv)));
+        glVertexAttribPointer(5, 4, GL_SHORT, GL_TRUE, sizeof(packedattribs), reinterpret_cast<const void*>(offsetof(packedattribs, qtangent)));
+    } else {
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glEnableVertexAttribArray(3);
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(0, sz_pos_attrib, GL_FLOAT, GL_FALSE, sizeof(attribs), reinterpret_cast<const void*>(0));
+        glVertexAttribPointer(1, sz_uv_attrib, GL_FLOAT, GL_FALSE, sizeof(attribs), reinterpret_cast<const void*>(sz_pos_attrib * sizeof(GLfloat)));
+        glVertexAttribPointer(2, sz_norm_attrib, GL_FLOAT, GL_FALSE, sizeof(attribs), reinterpret_cast<const void*>((sz_pos_attrib + sz_uv_attrib) * sizeof(GLfloat)));
+        glVertexAttribPointer(3, sz_tng_attrib, GL_FLOAT, GL_FALSE, sizeof(attribs), reinterpret_cast<const void*>((sz_pos_attrib + sz_uv_attrib + sz_norm_attrib) * sizeof(GLfloat)));
+        glVertexAttribPointer(4, sz_bitng_attrib, GL_FLOAT, GL_FALSE, sizeof(attribs), reinterpret_cast<const void*>((sz_pos_attrib + sz_uv_attrib + sz_norm_attrib + sz_tng_attrib) * sizeof(GLfloat)));
+    }
+
+    /* draw id and node advance per instance, base instance selects each draw's range as gl 4.3 has no gl_DrawID */
+    glBindBuffer(GL_ARRAY_BUFFER, b.instances);
+    glEnableVertexAttribArray(phong_drawid_attrib);
+    glEnableVertexAttribArray(phong_node_attrib);
+    glVertexAttribIPointer(phong_drawid_attrib, 1, GL_UNSIGNED_INT, sizeof(instancedata), reinterpret_cast<const void*>(offsetof(instancedata, drawid)));
+    glVertexAttribIPointer(phong_node_attrib, 1, GL_UNSIGNED_INT, sizeof(instancedata), reinterpret_cast<const void*>(offsetof(instancedata, node)));
+    glVertexAttribDivisor(phong_drawid_attrib, 1);
+    glVertexAttribDivisor(phong_node_attrib, 1);
+
+    /* unbind vao */
+    glBindVertexArray(0);
+
+}
+
+static aabb transformaabb(const aabb& box, const glm::mat4& m) {
+
+    /* move center, grow extent by absolute rotation and scale */
+    glm::vec3 center = (box.lo + box.hi) * 0.5f, extent = (box.hi - box.lo) * 0.5f;
+    glm::vec3 c(m * glm::vec4(center, 1.0f)), e(0.0f);
+    for (int col = 0; col < 3; ++col)
+        for (int row = 0; row < 3; ++row)
+            e[row] += std::fabs(m[col][row]) * extent[col];
+    aabb out = { c - e, c + e };
+    return out;
+
+}
+
+/* bvh build, ranges at or below leaf size stay leaves */
+#define bvh_leafsize 4
+
+static void buildbvh(scene& s) {
+
+    /* node matrices below the scene root, the root transform is applied to the frustum instead */
+    std::vector<glm::mat4> matrices(s.nodes.size());
+    for (std::size_t i = 0; i < s.nodes.size(); ++i)
+        matrices[i] = s.nodes[i].parent < 0 ? s.nodes[i].local : matrices[s.nodes[i].parent] * s.nodes[i].local;
+
+    /* one item per model instance */
+    s.cullitems.clear();
+    for (const model& m : s.models) {
+        const drawbatch& b = s.batches[m.batch];
+        const drawcommand& cmd = b.commands[m.draw];
+        for (GLuint i = cmd.baseinstance; i < cmd.baseinstance + cmd.instancecount; ++i) {
+            cullitem item = { static_cast<std::uint32_t>(m.batch), i, transformaabb(m.box, matrices[b.instancelist[i].node]) };
+            s.cullitems.push_back(item);
+        }
+    }
+
+    /* no instances, no tree */
+    s.bvh.clear();
+    if (s.cullitems.empty())
+        return;
+
+    /* split ranges top down at the centroid median of their longest axis */
+    s.bvh.assign(1, bvhnode());
+    std::vector<std::pair<std::uint32_t, std::pair<std::uint32_t, std::uint32_t>>> stack(1, std::make_pair(0u, std::make_pair(0u, static_cast<std::uint32_t>(s.cullitems.size()))));
+    while (!stack.empty()) {
+        std::uint32_t n = stack.back().first, begin = stack.back().second.first, end = stack.back().second.second;
+        stack.pop_back();
+
+        /* bound items and their centroids */
+        aabb box = { glm::vec3(0.0f), glm::vec3(0.0f) }, centroids = box;
+        for (std::uint32_t i = begin; i < end; ++i) {
+            glm::vec3 centroid = (s.cullitems[i].box.lo + s.cullitems[i].box.hi) * 0.5f;
+            box.lo = i == begin ? s.cullitems[i].box.lo : glm::min(box.lo, s.cullitems[i].box.lo);
+            box.hi = i == begin ? s.cullitems[i].box.hi : glm::max(box.hi, s.cullitems[i].box.hi);
+            centroids.lo = i == begin ? centroid : glm::min(centroids.lo, centroid);
+            centroids.hi = i == begin ? centroid : glm::max(centroids.hi, centroid);
+        }
+        s.bvh[n].box = box;
+
+        /* leaf when small or when centroids coincide */
+        glm::vec3 extent = centroids.hi - centroids.lo;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+        if (end - begin <= bvh_leafsize || extent[axis] <= 0.0f) {
+            s.bvh[n].first = begin;
+            s.bvh[n].count = end - begin;
+            s.bvh[n].leaf = true;
+            continue;
+        }
+
+        /* inner node, children are allocated side by side */
+        std::uint32_t mid = begin + (end - begin) / 2;
+        std::nth_element(s.cullitems.begin() + begin, s.cullitems.begin() + mid, s.cullitems.begin() + end, [axis](const cullitem& a, const cullitem& b) {
+            return a.box.lo[axis] + a.box.hi[axis] < b.box.lo[axis] + b.box.hi[axis];
+        });
+        std::uint32_t left = static_cast<std::uint32_t>(s.bvh.size());
+        s.bvh[n].first = left;
+        s.bvh[n].count = 0;
+        s.bvh[n].leaf = false;
+        s.bvh.resize(s.bvh.size() + 2);
+        stack.push_back(std::make_pair(left, std::make_pair(begin, mid)));
+        stack.push_back(std::make_pair(left + 1, std::make_pair(mid, end)));
+    }
+
+}
+
+/* frustum planes as structure of arrays, padded to 8 with planes nothing is behind */
+typedef struct {
+    float n[3][8];
+    float a[3][8];
+    float d[8];
+} frustum;
+
+/* frustum test results */
+#define cull_outside 0
+#define cull_intersect 1
+#define cull_inside 2
+
+static void frustumplanes(const glm::mat4& m, glm::vec4 planes[6]) {
+
+    /* planes are sums and differences of the w row with the others, normalized to measure distances */
+    for (int p = 0; p < 6; ++p) {
+        for (int col = 0; col < 4; ++col)
+            planes[p][col] = m[col][3] + (p % 2 == 0 ? 1.0f : -1.0f) * m[col][p / 2];
+        float len = glm::length(glm::vec3(planes[p]));
+        planes[p] /= len > 0.0f ? len : 1.0f;
+    }
+
+}
+
+static void extractfrustum(const glm::mat4& m, frustum& f) {
+
+    /* six planes and two padding planes */
+    glm::vec4 planes[6];
+    frustumplanes(m, planes);
+    for (int p = 0; p < 8; ++p) {
+        glm::vec4 plane = p < 6 ? planes[p] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        for (int c = 0; c < 3; ++c) {
+            f.n[c][p] = plane[c];
+            f.a[c][p] = std::fabs(plane[c]);
+        }
+        f.d[p] = plane[3];
+    }
+
+}
+
+static int testfrustum(const frustum& f, const aabb& box) {
+
+    /* signed distance of box center and projected box radius per plane */
+    glm::vec3 center = (box.lo + box.hi) * 0.5f, extent = (box.hi - box.lo) * 0.5f;
+    int outside = 0, intersect = 0;
+#ifdef __SSE__
+    /* four planes per step */
+    __m128 zero = _mm_setzero_ps();
+    for (int p = 0; p < 8; p += 4) {
+        __m128 distance = _mm_loadu_ps(f.d + p), radius = zero;
+        for (int c = 0; c < 3; ++c) {
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(center[c]), _mm_loadu_ps(f.n[c] + p)));
+            radius = _mm_add_ps(radius, _mm_mul_ps(_mm_set1_ps(extent[c]), _mm_loadu_ps(f.a[c] + p)));
+        }
+        outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        intersect |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero));
+    }
+#else
+    /* one plane per step */
+    for (int p = 0; p < 6; ++p) {
+        float distance = f.d[p], radius = 0.0f;
+        for (int c = 0; c < 3; ++c) {
+            distance += center[c] * f.n[c][p];
+            radius += extent[c] * f.a[c][p];
+        }
+        outside |= distance + radius < 0.0f;
+        intersect |= distance - radius < 0.0f;
+    }
+#endif
+    return outside ? cull_outside : intersect ? cull_intersect : cull_inside;
+
+}
+
+static void cullscene(const scene& s, const frustum& f, std::vector<std::vector<char>>& visible) {
+
+    /* walk bvh, subtrees fully inside skip further tests */
+    if (s.cullitems.empty() || s.bvh.empty())
+        return;
+    std::vector<std::pair<std::uint32_t, bool>> stack(1, std::make_pair(0u, false));
+    while (!stack.empty()) {
+        const bvhnode& node = s.bvh[stack.back().first];
+        bool inside = stack.back().second;
+        stack.pop_back();
+        int result = inside ? cull_inside : testfrustum(f, node.box);
+        if (result == cull_outside)
+            continue;
+
+        /* mark leaf items, testing them on their own when the leaf straddles a plane */
+        if (node.leaf) {
+            for (std::uint32_t i = node.first; i < node.first + node.count; ++i)
+                if (result == cull_inside || testfrustum(f, s.cullitems[i].box) != cull_outside)
+                    visible[s.cullitems[i].batch][s.cullitems[i].instance] = 1;
+            continue;
+        }
+        stack.push_back(std::make_pair(node.first, result == cull_inside));
+        stack.push_back(std::make_pair(node.first + 1, result == cull_inside));
+    }
+
+}
+
+static GLint vtexpagecount(GLint size, GLint level) {
+
+    /* pages across one axis of a level */
+    return (std::max(1, size >> level) + vtex_pagesize - 1) / vtex_pagesize;
+
+}
+
+static std::size_t vtexpagebytes(GLenum format) {
+
+    /* bytes of a page with its border, rows of texels or rows of blocks */
+    return format == GL_RGBA8 ? vtex_slotsize * vtex_slotsize * 4 : (vtex_slotsize / 4) * (vtex_slotsize / 4) * texblocksize(format);
+
+}
+
+static void buildvtex(const unsigned char* rgba, int w, int h, std::uint64_t hash, int kind, GLenum format, const std::string& vtexpath) {
+
+    /* open stream, quietly leaving the tiles out if they cannot be written */
+    std::ofstream stream(vtexpath, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!stream.good()) {
+        std::cerr << "cannot write virtual texture " << vtexpath << std::endl;
+        return;
+    }
+
+    /* levels down to a single page, every page encodes to the same size */
+    GLint nlevels = 1;
+    while ((std::max(w, h) >> (nlevels - 1)) > vtex_pagesize && nlevels < vtex_maxlevels)
+        ++nlevels;
+    std::uint32_t npages = 0;
+    for (GLint l = 0; l < nlevels; ++l)
+        npages += vtexpagecount(w, l) * vtexpagecount(h, l);
+    std::size_t pagebytes = vtexpagebytes(format);
+
+    /* write header and page table */
+    vtexheader header = { vtex_magic, vtex_version, hash, static_cast<std::uint32_t>(kind), format, static_cast<std::uint32_t>(w), static_cast<std::uint32_t>(h), static_cast<std::uint32_t>(nlevels), npages };
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (std::uint32_t i = 0; i < npages; ++i) {
+        vtexpage page = { sizeof(vtexheader) + npages * sizeof(vtexpage) + i * pagebytes, static_cast<std::uint32_t>(pagebytes), 0 };
+        stream.write(reinterpret_cast<const char*>(&page), sizeof(page));
+    }
+
+    /* cut each level a row of pages at a time, borders repeat neighbouring texels and clamp at the edges */
+    std::vector<unsigned char> current(rgba, rgba + static_cast<std::size_t>(w) * h * 4), next, strip, encoded;
+    for (GLint l = 0; l < nlevels; ++l) {
+        GLint pagesx = vtexpagecount(header.width, l), pagesy = vtexpagecount(header.height, l);
+        int stripw = pagesx * vtex_slotsize;
+        strip.resize(static_cast<std::size_t>(stripw) * vtex_slotsize * 4);
+        for (GLint py = 0; py < pagesy; ++py) {
+            for (int sy = 0; sy < vtex_slotsize; ++sy)
+                for (int sx = 0; sx < stripw; ++sx) {
+                    int x = std::min(std::max(sx / vtex_slotsize * vtex_pagesize - vtex_border + sx % vtex_slotsize, 0), w - 1);
+                    int y = std::min(std::max(py * vtex_pagesize - vtex_border + sy, 0), h - 1);
+                    std::memcpy(strip.data() + 4 * (static_cast<std::size_t>(sy) * stripw + sx), current.data() + 4 * (static_cast<std::size_t>(y) * w + x), 4);
+                }
+
+            /* split the strip into pages, rows of texels or rows of blocks */
+            if (format == GL_RGBA8) {
+                for (GLint px = 0; px < pagesx; ++px)
+                    for (int sy = 0; sy < vtex_slotsize; ++sy)
+                        stream.write(reinterpret_cast<const char*>(strip.data() + 4 * (static_cast<std::size_t>(sy) * stripw + px * vtex_slotsize)), vtex_slotsize * 4);
+            } else {
+                encodetexlevel(strip.data(), stripw, vtex_slotsize, format, encoded);
+                std::size_t szblock = texblocksize(format);
+                for (GLint px = 0; px < pagesx; ++px)
+                    for (int by = 0; by < vtex_slotsize / 4; ++by)
+                        stream.write(reinterpret_cast<const char*>(encoded.data() + (static_cast<std::size_t>(by) * pagesx + px) * (vtex_slotsize / 4) * szblock), (vtex_slotsize / 4) * szblock);
+            }
+        }
+        if (l + 1 < nlevels) {
+            downsampletex(current, w, h, next);
+            current.swap(next);
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+    }
+    stream.close();
+
+}
+
+static bool mapvtex(const std::string& vtexpath, bool checkhash, std::uint64_t hash, int kind, vtexture& vt) {
+
+    /* map tiles and validate header, the coarsest level must be a single page, any kind matches if kind is negative */
+    if (!mapfile(vtexpath, vt.file))
+        return false;
+    if (vt.file.size < sizeof(vtexheader)) {
+        unmapfile(vt.file);
+        return false;
+    }
+    const vtexheader* header = reinterpret_cast<const vtexheader*>(vt.file.data);
+    bool s3tc = header->format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || header->format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    if ((!s3tc && header->format != GL_RGBA8 && header->format != GL_COMPRESSED_RG_RGTC2) || header->magic != vtex_magic || header->version != vtex_version || (checkhash && header->hash != hash) || (kind >= 0 && header->kind != static_cast<std::uint32_t>(kind))
+        || (s3tc && !s3tcsupported) || header->nlevels == 0 || header->nlevels > vtex_maxlevels || header->width == 0 || header->height == 0 || (std::max(header->width, header->height) >> (header->nlevels - 1)) > vtex_pagesize) {
+        unmapfile(vt.file);
+        return false;
+    }
+
+    /* page counts must match the levels, and every page must be a whole page of the format lying within the file */
+    vt.format = header->format;
+    vt.width = static_cast<GLint>(header->width);
+    vt.height = static_cast<GLint>(header->height);
+    vt.nlevels = static_cast<GLint>(header->nlevels);
+    std::size_t npages = 0;
+    for (GLint l = 0; l < vt.nlevels; ++l) {
+        vt.fileoffsets[l] = npages;
+        npages += vtexpagecount(vt.width, l) * vtexpagecount(vt.height, l);
+    }
+    vt.pages = reinterpret_cast<const vtexpage*>(vt.file.data + sizeof(vtexheader));
+    bool valid = npages == header->npages && npages <= (vt.file.size - sizeof(vtexheader)) / sizeof(vtexpage);
+    std::size_t pagebytes = vtexpagebytes(vt.format);
+    for (std::size_t i = 0; valid && i < npages; ++i)
+        valid = vt.pages[i].size == pagebytes && vt.pages[i].size <= vt.file.size && vt.pages[i].offset <= vt.file.size - vt.pages[i].size;
+    if (!valid)
+        unmapfile(vt.file);
+    return valid;
+
+}
+
+static bool openvtex(const std::string& vtexpath, bool hassource, std::uint64_t hash, std::shared_future<int> kind, vtexture& vt) {
+
+    /* while kind is still unknown, decode the source right away unless tiles of some kind will serve it anyway */
+    int x = 0, y = 0, nc;
+    unsigned char* data = nullptr;
+    bool decoded = false;
+    if (hassource && kind.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        vtexture probe;
+        if (mapvtex(vtexpath, true, hash, -1, probe))
+            unmapfile(probe.file);
+        else {
+            mappedfile source;
+            if (mapfile(vtexpath.substr(0, vtexpath.size() - 5), source))
+                data = stbi_load_from_memory(source.data, static_cast<int>(source.size), &x, &y, &nc, 4);
+            unmapfile(source);
+            decoded = true;
+        }
+    }
+
+    /* tiles are keyed by the hash of the image next to them that they were cut from, tiles without one are taken as they are */
+    if (mapvtex(vtexpath, hassource, hash, kind.get(), vt)) {
+        if (data != nullptr)
+            stbi_image_free(data);
+        return true;
+    }
+
+    /* decode source and drop its mapping, unless done above */
+    if (!hassource)
+        return false;
+    if (!decoded) {
+        mappedfile source;
+        if (!mapfile(vtexpath.substr(0, vtexpath.size() - 5), source))
+            return false;
+        data = stbi_load_from_memory(source.data, static_cast<int>(source.size), &x, &y, &nc, 4);
+        unmapfile(source);
+    }
+    if (data == nullptr)
+        return false;
+
+    /* compress pages like cached textures, then tile and map the result */
+    GLenum format = GL_RGBA8;
+    if (kind.get() == texkind_normal)
+        format = GL_COMPRESSED_RG_RGTC2;
+    else if (s3tcsupported) {
+        format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        for (std::size_t i = 3; i < static_cast<std::size_t>(x) * y * 4; i += 4)
+            if (data[i] != 255) {
+                format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+                break;
+            }
+    }
+    buildvtex(data, x, y, hash, kind.get(), format, vtexpath);
+    stbi_image_free(data);
+    return mapvtex(vtexpath, true, hash, kind.get(), vt);
+
+}
+
+static GLuint stagevtexpage(GLenum format, const unsigned char* data, std::size_t size) {
+
+    /* stage page with its border in a texture of its own on whichever context uploads */
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, format, vtex_slotsize, vtex_slotsize);
+    if (format == GL_RGBA8)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vtex_slotsize, vtex_slotsize, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    else
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vtex_slotsize, vtex_slotsize, format, static_cast<GLsizei>(size), data);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return tex;
+
+}
+
+static bool placevtexpage(vtexture& vt, std::size_t page, std::uint64_t feedbackframe, GLuint staging) {
+
+    /* free slot, else the least recently used page the last feedback did not ask for, the coarsest page stays */
+    std::vector<GLint>::iterator it = std::find(vt.owners.begin(), vt.owners.end(), -1);
+    GLint slot = it != vt.owners.end() ? static_cast<GLint>(it - vt.owners.begin()) : -1;
+    for (GLint i = 0; slot < 0 && i < static_cast<GLint>(vt.owners.size()); ++i) {
+        std::size_t owner = static_cast<std::size_t>(vt.owners[i]);
+        if (owner == vt.tableoffsets[vt.nlevels - 1] || vt.lastused[owner] >= feedbackframe)
+            continue;
+        if (slot < 0 || vt.lastused[owner] < vt.lastused[vt.owners[slot]])
+            slot = i;
+    }
+    if (slot < 0)
+        return false;
+
+    /* take the slot over */
+    if (vt.owners[slot] >= 0)
+        vt.slots[vt.owners[slot]] = -1;
+    vt.owners[slot] = static_cast<GLint>(page);
+    vt.slots[page] = slot;
+    vt.dirty = true;
+
+    /* copy staged page with its border into the slot on the gpu */
+    GLint x = slot % vtex_atlaspages * vtex_slotsize, y = slot / vtex_atlaspages * vtex_slotsize;
+    glCopyImageSubData(staging, GL_TEXTURE_2D, 0, 0, 0, 0, vt.atlas, GL_TEXTURE_2D, 0, x, y, 0, vtex_slotsize, vtex_slotsize, 1);
+    return true;
+
+}
+
+static void updatevtex(vtexture& vt) {
+
+    /* resolve coarse to fine, missing pages take their parent's mapping, parents clamp to the pages of their level */
+    glBindTexture(GL_TEXTURE_2D, vt.pagetable);
+    for (GLint l = vt.nlevels - 1; l >= 0; --l) {
+        GLint across = std::max(1, vt.tablewidth >> l), down = std::max(1, vt.tableheight >> l);
+        GLint pagesx = vtexpagecount(vt.width, l), pagesy = vtexpagecount(vt.height, l);
+        for (GLint y = 0; y < pagesy; ++y)
+            for (GLint x = 0; x < pagesx; ++x) {
+                std::size_t page = vt.tableoffsets[l] + static_cast<std::size_t>(y) * across + x;
+                GLint slot = vt.slots[page];
+                if (slot >= 0)
+                    vt.entries[page] = static_cast<GLuint>(slot % vtex_atlaspages) | static_cast<GLuint>(slot / vtex_atlaspages) << 8 | static_cast<GLuint>(l) << 16 | 1u << 24;
+                else if (l + 1 < vt.nlevels) {
+                    GLint parentx = std::min(x / 2, vtexpagecount(vt.width, l + 1) - 1), parenty = std::min(y / 2, vtexpagecount(vt.height, l + 1) - 1);
+                    vt.entries[page] = vt.entries[vt.tableoffsets[l + 1] + static_cast<std::size_t>(parenty) * std::max(1, vt.tablewidth >> (l + 1)) + parentx];
+                } else
+                    vt.entries[page] = 0;
+            }
+        glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, across, down, GL_RED_INTEGER, GL_UNSIGNED_INT, vt.entries.data() + vt.tableoffsets[l]);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    vt.dirty = false;
+
+}
+
+static void stagevirtual(vtexture& vt) {
+
+    /* page table levels are padded to powers of two so they form a mip chain */
+    vt.tablewidth = 1;
+    while (vt.tablewidth < vtexpagecount(vt.width, 0))
+        vt.tablewidth *= 2;
+    vt.tableheight = 1;
+    while (vt.tableheight < vtexpagecount(vt.height, 0))
+        vt.tableheight *= 2;
+    std::size_t nentries = 0;
+    for (GLint l = 0; l < vt.nlevels; ++l) {
+        vt.tableoffsets[l] = nentries;
+        nentries += static_cast<std::size_t>(std::max(1, vt.tablewidth >> l)) * std::max(1, vt.tableheight >> l);
+    }
+    vt.entries.assign(nentries, 0);
+    vt.slots.assign(nentries, -1);
+    vt.lastused.assign(nentries, 0);
+    vt.loading.assign(nentries, 0);
+    vt.owners.assign(vtex_atlaspages * vtex_atlaspages, -1);
+    vt.inflight = 0;
+
+    /* atlas holds pages with their borders, filtering never leaves a page */
+    glGenTextures(1, &vt.atlas);
+    glBindTexture(GL_TEXTURE_2D, vt.atlas);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexStorage2D(GL_TEXTURE_2D, 1, vt.format, vtex_atlaspages * vtex_slotsize, vtex_atlaspages * vtex_slotsize);
+
+    /* page table holds packed entries, integer textures are only complete with nearest filtering */
+    glGenTextures(1, &vt.pagetable);
+    glBindTexture(GL_TEXTURE_2D, vt.pagetable);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexStorage2D(GL_TEXTURE_2D, vt.nlevels, GL_R32UI, vt.tablewidth, vt.tableheight);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    /* coarsest level is a single page that stays resident in the first slot, every other page falls back to it */
+    std::size_t top = vt.tableoffsets[vt.nlevels - 1];
+    const vtexpage& toppage = vt.pages[vt.fileoffsets[vt.nlevels - 1]];
+    vt.owners[0] = static_cast<GLint>(top);
+    vt.slots[top] = 0;
+    glBindTexture(GL_TEXTURE_2D, vt.atlas);
+    if (vt.format == GL_RGBA8)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vtex_slotsize, vtex_slotsize, GL_RGBA, GL_UNSIGNED_BYTE, vt.file.data + toppage.offset);
+    else
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vtex_slotsize, vtex_slotsize, vt.format, static_cast<GLsizei>(toppage.size), vt.file.data + toppage.offset);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    updatevtex(vt);
+
+}
+
+static void closevtex(vtexture& vt) {
+
+    /* delete atlas and page table with the tile mapping */
+    glDeleteTextures(1, &vt.atlas);
+    glDeleteTextures(1, &vt.pagetable);
+    unmapfile(vt.file);
+    vt = vtexture();
+    vt.id = -1;
+
+}
+
+static void beginvirtual(std::size_t v, const vtexture& opened) {
+
+    /* take over the staged texture */
+    vtexture& vt = texreg.vtextures[v];
+    vt = opened;
+
+    /* feedback bits are laid out anew over the live virtual textures so freed ranges are reused, reallocating drops the round being read back */
+    texreg.vtexbits = 0;
+    for (vtexture& live : texreg.vtextures)
+        if (live.id >= 0 && !live.entries.empty()) {
+            live.firstbit = texreg.vtexbits;
+            texreg.vtexbits += live.entries.size();
+        }
+    std::vector<GLuint> none((texreg.vtexbits + 31) / 32, 0);
+    if (texreg.vtexrequests == 0)
+        glGenBuffers(1, &texreg.vtexrequests);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, texreg.vtexrequests);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, none.size() * sizeof(GLuint), none.data(), GL_DYNAMIC_READ);
+    if (texreg.texfeedbackfence != nullptr) {
+        glDeleteSync(texreg.texfeedbackfence);
+        texreg.texfeedbackfence = nullptr;
+    }
+
+    /* publish, locations below -1 read as virtual textures */
+    texentry entry = { -2 - static_cast<GLint>(v), vt.width, vt.height, 0 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, texreg.textable);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, vt.id * sizeof(texentry), sizeof(texentry), &entry);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+}
+
+/* texture streaming, textures start at their first level within the initial size and feedback asks for finer ones */
+#define texstream_initialsize 64
+#define texstream_maxinflight 4
+#define texstream_nofeedback 0xffffffffu
+
+static std::uint32_t initialresident(const preparedtex& pt) {
+
+    /* first level within the initial size, raw rgba is pinned at full resolution */
+    std::uint32_t resident = 0;
+    while (pt.format != GL_RGBA8 && resident + 1 < pt.levels.size() && std::max(pt.levels[resident].width, pt.levels[resident].height) > texstream_initialsize)
+        ++resident;
+    return resident;
+
+}
+
+static GLsizei texchainlength(GLsizei width, GLsizei height) {
+
+    /* levels down to 1x1 */
+    GLsizei nlevels = 1;
+    while ((std::max(width, height) >> nlevels) > 0)
+        ++nlevels;
+    return nlevels;
+
+}
+
+static std::size_t streamtexbytes(const streamtex& st, std::uint32_t resident) {
+
+    /* levels from resident down, raw rgba gets a generated chain of about a third more */
+    if (st.pinned)
+        return st.source.levels[0].size / 3 * 4;
+    std::size_t bytes = 0;
+    for (std::size_t l = resident; l < st.source.levels.size(); ++l)
+        bytes += st.source.levels[l].size;
+    return bytes;
+
+}
+
+static GLuint stagetex(const preparedtex& pt, std::uint32_t first) {
+
+    /* stage levels from first down in a texture of their own on whichever context uploads, raw rgba is mipped there */
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    if (pt.format == GL_RGBA8) {
+        glTexStorage2D(GL_TEXTURE_2D, texchainlength(pt.levels[0].width, pt.levels[0].height), GL_RGBA8, pt.levels[0].width, pt.levels[0].height);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, pt.levels[0].width, pt.levels[0].height, GL_RGBA, GL_UNSIGNED_BYTE, pt.data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    } else {
+        glTexStorage2D(GL_TEXTURE_2D, static_cast<GLsizei>(pt.levels.size() - first), pt.format, pt.levels[first].width, pt.levels[first].height);
+        for (std::uint32_t l = first; l < pt.levels.size(); ++l)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(l - first), 0, 0, pt.levels[l].width, pt.levels[l].height, pt.format, pt.levels[l].size, pt.data + pt.levels[l].offset);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return tex;
+
+}
+
+static void growtexbucket(texbucket& bucket) {
+
+    /* allocate doubled storage, parameters as for all scene textures */
+    GLsizei capacity = std::max<GLsizei>(texarray_minlayers, 2 * static_cast<GLsizei>(bucket.layers.size()));
+    GLuint array;
+    glGenTextures(1, &array);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, bucket.nlevels, bucket.format, bucket.width, bucket.height, capacity);
+
+    /* carry existing layers over on the gpu */
+    if (bucket.array != 0) {
+        for (GLsizei l = 0; l < bucket.nlevels; ++l)
+            glCopyImageSubData(bucket.array, GL_TEXTURE_2D_ARRAY, l, 0, 0, 0, array, GL_TEXTURE_2D_ARRAY, l, 0, 0, 0, std::max(1, bucket.width >> l), std::max(1, bucket.height >> l), static_cast<GLsizei>(bucket.layers.size()));
+        glDeleteTextures(1, &bucket.array);
+    }
+    bucket.array = array;
+    bucket.layers.resize(capacity, -1);
+
+}
+
+static void releaselayer(GLint location) {
+
+    /* free layer, dropping its array once empty */
+    texbucket& bucket = texreg.texbuckets[location >> 16];
+    bucket.layers[location & 0xffff] = -1;
+    if (std::count(bucket.layers.begin(), bucket.layers.end(), -1) == static_cast<std::ptrdiff_t>(bucket.layers.size())) {
+        glDeleteTextures(1, &bucket.array);
+        bucket.array = 0;
+        bucket.layers.clear();
+    }
+
+}
+
+static void publishtex(std::size_t id) {
+
+    /* location, full resolution size and finest sampled level */
+    const streamtex& st = texreg.textures[id];
+    texentry entry = { st.location, static_cast<GLint>(st.source.levels[0].width), static_cast<GLint>(st.source.levels[0].height), static_cast<GLint>(st.resident) };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, texreg.textable);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, id * sizeof(texentry), sizeof(texentry), &entry);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+}
+
+static bool updatetex(std::size_t id, std::uint32_t resident, GLuint staging) {
 
-    /* load texture and free image */
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, x, y, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    stbi_image_free(data);
+    /* copy levels finer than those in the layer from staging on the gpu, coarser residency only raises the sampled min level */
+    streamtex& st = texreg.textures[id];
+    const preparedtex& pt = st.source;
+    if (resident < st.resident) {
+        const texbucket& bucket = texreg.texbuckets[st.location >> 16];
+        for (std::uint32_t l = resident; l < st.resident; ++l)
+            glCopyImageSubData(staging, GL_TEXTURE_2D, static_cast<GLint>(l - resident), 0, 0, 0, bucket.array, GL_TEXTURE_2D_ARRAY, static_cast<GLint>(l), 0, 0, st.location & 0xffff, pt.levels[l].width, pt.levels[l].height, 1);
+    }
+    texreg.texbytes -= streamtexbytes(st, st.resident);
+    texreg.texbytes += streamtexbytes(st, resident);
+    st.resident = resident;
+    publishtex(id);
+    return true;
+
+}
 
-    /* generate mipmap */
-    glGenerateMipmap(GL_TEXTURE_2D);
+static bool placetex(std::size_t id, std::uint32_t resident, GLuint staging) {
+
+    /* placed textures keep their layer, staging holds the chain from resident down */
+    streamtex& st = texreg.textures[id];
+    if (st.location >= 0)
+        return updatetex(id, resident, staging);
+
+    /* bucket key is format, size and level count of the full chain, so residency changes never move layers */
+    const preparedtex& pt = st.source;
+    GLsizei width = pt.levels[0].width, height = pt.levels[0].height;
+    GLsizei nlevels = st.pinned ? texchainlength(width, height) : static_cast<GLsizei>(pt.levels.size());
+
+    /* find bucket of that key, else take a free slot */
+    std::size_t b = 0;
+    while (b < texreg.texbuckets.size() && !(texreg.texbuckets[b].array != 0 && texreg.texbuckets[b].format == pt.format && texreg.texbuckets[b].width == width && texreg.texbuckets[b].height == height && texreg.texbuckets[b].nlevels == nlevels))
+        ++b;
+    if (b == texreg.texbuckets.size()) {
+        b = 0;
+        while (b < texreg.texbuckets.size() && texreg.texbuckets[b].array != 0)
+            ++b;
+        if (b == texarray_maxbuckets)
+            return false;
+        if (b == texreg.texbuckets.size())
+            texreg.texbuckets.emplace_back();
+        texbucket& bucket = texreg.texbuckets[b];
+        bucket.array = 0;
+        bucket.format = pt.format;
+        bucket.width = width;
+        bucket.height = height;
+        bucket.nlevels = nlevels;
+        bucket.layers.clear();
+    }
 
-    /* unbind and return texture */
-    glBindTexture(GL_TEXTURE_2D, 0);
-    return tex;
+    /* take a free layer, growing the bucket if it is full */
+    texbucket& bucket = texreg.texbuckets[b];
+    std::vector<GLint>::iterator it = std::find(bucket.layers.begin(), bucket.layers.end(), -1);
+    if (it == bucket.layers.end()) {
+        std::size_t full = bucket.layers.size();
+        growtexbucket(bucket);
+        it = bucket.layers.begin() + full;
+    }
+    GLint layer = static_cast<GLint>(it - bucket.layers.begin());
+    *it = static_cast<GLint>(id);
+
+    /* copy staged levels into the layer on the gpu, raw rgba was mipped in staging */
+    for (GLsizei l = static_cast<GLsizei>(resident); l < nlevels; ++l)
+        glCopyImageSubData(staging, GL_TEXTURE_2D, l - static_cast<GLsizei>(resident), 0, 0, 0, bucket.array, GL_TEXTURE_2D_ARRAY, l, 0, 0, layer, std::max(1, width >> l), std::max(1, height >> l), 1);
+    texreg.texbytes += streamtexbytes(st, resident);
+    st.resident = resident;
+    st.location = texarray_location(b, layer);
+    publishtex(id);
+    return true;
 
 }
 
-/* particle data */
-typedef struct __attribute__((packed)) {
-    float x, y, z;
-    float vx, vy, vz;
-    float ax, ay, az;
-    float scale;
-    float initialx, initialy, initialz;
-    float initialvx, initialvy, initialvz;
-} particle;
+static void beginstreaming(std::size_t id, preparedtex& prepared, GLuint staging) {
+
+    /* take over prepared texture with its cache mapping, starting small with the levels staged from its initial resident level */
+    streamtex& st = texreg.textures[id];
+    std::swap(st.source, prepared);
+    st.pinned = st.source.format == GL_RGBA8;
+    st.resident = initialresident(st.source);
+    st.wanted = st.resident;
+    st.lastused = 0;
+    st.unplaced = !placetex(id, st.resident, staging);
+    if (st.unplaced)
+        std::cerr << "too many texture sizes, texture " << id << " left out" << std::endl;
+    if (st.pinned)
+        std::vector<unsigned char>().swap(st.source.blob);
 
-static GLuint genparticletex() {
+}
 
-    /* generate and bind texture */
-    GLuint tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_RECTANGLE, tex);
+static bool evicttex(std::size_t keep) {
 
-    /* set texture params */
-    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    /* least recently used texture holding more than the last feedback asked of it */
+    std::size_t victim = texreg.textures.size();
+    for (std::size_t id = 0; id < texreg.textures.size(); ++id) {
+        const streamtex& st = texreg.textures[id];
+        if (id == keep || st.pinned || st.streaming || st.location < 0 || st.resident + 1 >= st.source.levels.size() || (st.lastused >= texreg.texfeedbackframe && st.wanted <= st.resident))
+            continue;
+        if (victim == texreg.textures.size() || st.lastused < texreg.textures[victim].lastused)
+            victim = id;
+    }
 
-    /* allocate particle data */
-    #define nparticles 8192
-    std::vector<particle> data;
-    data.reserve(nparticles);
-    particle* pdata = data.data();
+    /* stop sampling its finest level, the layer keeps its storage */
+    return victim < texreg.textures.size() && placetex(victim, texreg.textures[victim].resident + 1, 0);
 
-    /* generate initial data */
-    #define rand01() ((std::rand() % 10001) / 10000.0f)
-    #define randrange(s, e) ((s) + ((e) - (s)) * rand01())
-    for (int i = 0; i < nparticles; ++i) {
-        particle& p = pdata[i];
-        p.x = p.initialx = randrange(-5.5f, 5.5f);
-        p.y = randrange(0.0f, 5.5f);
-        p.initialy = randrange(4.5f, 6.0f);
-        p.z = p.initialz = randrange(-5.5f, 5.5f);
-        p.vx = p.initialvx = randrange(-0.5f, 0.5f);
-        p.vy = p.initialvy = randrange(-0.5f, -0.15f);
-        p.vz = p.initialvz = randrange(-0.5f, 0.5f);
-        p.ax = randrange(-0.015f, 0.015f);
-        p.ay = randrange(-0.015f, -0.001f);
-        p.az = randrange(-0.015f, 0.015f);
-        p.scale = randrange(0.025f, 0.085f);
+}
+
+static void growtexregistry(std::size_t needed) {
+
+    /* double table and feedback until the id fits, the new part reads as unloaded and unsampled */
+    if (needed <= texreg.capacity)
+        return;
+    std::size_t capacity = std::max<std::size_t>(texreg.capacity, texregistry_initialsize);
+    while (capacity < needed)
+        capacity *= 2;
+    texentry unloadedentry = { -1, 0, 0, 0 };
+    std::vector<texentry> unloaded(capacity, unloadedentry);
+    std::vector<GLuint> nofeedback(capacity, texstream_nofeedback);
+    GLuint buffers[2];
+    glGenBuffers(2, buffers);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[0]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(texentry), unloaded.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GLuint), nofeedback.data(), GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    /* carry entries and feedback over on the gpu, the round being read back is dropped */
+    if (texreg.capacity > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, texreg.textable);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, texreg.capacity * sizeof(texentry));
+        glBindBuffer(GL_COPY_READ_BUFFER, texreg.texfeedback);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, texreg.capacity * sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &texreg.textable);
+        glDeleteBuffers(1, &texreg.texfeedback);
+    }
+    if (texreg.texfeedbackfence != nullptr) {
+        glDeleteSync(texreg.texfeedbackfence);
+        texreg.texfeedbackfence = nullptr;
     }
+    texreg.textable = buffers[0];
+    texreg.texfeedback = buffers[1];
+    texreg.capacity = capacity;
 
-    /* load texture */
-    #define szparticle (sizeof(particle) / sizeof(float))
-    glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_R32F, szparticle, nparticles, 0, GL_RED, GL_FLOAT, pdata);
+}
 
-    /* unbind and return texture */
-    glBindTexture(GL_TEXTURE_RECTANGLE, 0);
-    return tex;
+static void freetex(GLint id) {
+
+    /* drop array layer or virtual texture with their mappings */
+    streamtex& st = texreg.textures[id];
+    if (st.location >= 0) {
+        releaselayer(st.location);
+        texreg.texbytes -= streamtexbytes(st, st.resident);
+    }
+    if (st.vtex >= 0)
+        closevtex(texreg.vtextures[st.vtex]);
+    unmapfile(st.source.cache);
+    st.source = preparedtex();
+    st.location = -1;
+    st.vtex = -1;
+
+    /* forget key, the id is handed out again */
+    texreg.keys.erase(st.key);
+    texreg.freeids.push_back(id);
+    texentry entry = { -1, 0, 0, 0 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, texreg.textable);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, id * sizeof(texentry), sizeof(texentry), &entry);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
 }
 
-static GLuint genparticletexempty() {
+static bool reaptex(GLint id) {
 
-    /* generate and bind texture */
-    GLuint tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_RECTANGLE, tex);
+    /* unreferenced textures are freed once no worker reads for them anymore, true if unreferenced */
+    const streamtex& st = texreg.textures[id];
+    if (st.refs > 0)
+        return false;
+    if (!st.streaming && (st.vtex < 0 || texreg.vtextures[st.vtex].inflight == 0))
+        freetex(id);
+    return true;
 
-    /* set texture params */
-    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
 
-    /* set texture size */
-    glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_R32F, szparticle, nparticles, 0, GL_RED, GL_FLOAT, nullptr);
+static void streampages(const std::vector<GLuint>& requests) {
+
+    /* stamp pages the feedback asked for, collecting those not resident yet */
+    for (std::size_t v = 0; v < texreg.vtextures.size(); ++v) {
+        vtexture& vt = texreg.vtextures[v];
+        if (vt.atlas == 0)
+            continue;
+        std::vector<std::size_t> missing;
+        for (std::size_t page = 0; page < vt.slots.size(); ++page) {
+            std::size_t bit = vt.firstbit + page;
+            if (requests[bit / 32] == 0) {
+                page += 31 - bit % 32;
+                continue;
+            }
+            if ((requests[bit / 32] >> (bit % 32) & 1u) == 0)
+                continue;
+            vt.lastused[page] = texreg.texframe;
+            if (vt.slots[page] < 0 && !vt.loading[page])
+                missing.push_back(page);
+        }
 
-    /* unbind and return texture */
-    glBindTexture(GL_TEXTURE_RECTANGLE, 0);
-    return tex;
+        /* coarse pages first so fallbacks sharpen level by level, levels sit in ascending table order */
+        std::sort(missing.begin(), missing.end(), std::greater<std::size_t>());
+        for (std::size_t page : missing) {
+            if (vt.inflight >= vtex_maxinflight)
+                break;
+            GLint l = vt.nlevels - 1;
+            while (vt.tableoffsets[l] > page)
+                --l;
+            GLint across = std::max(1, vt.tablewidth >> l);
+            GLint x = static_cast<GLint>((page - vt.tableoffsets[l]) % across), y = static_cast<GLint>((page - vt.tableoffsets[l]) / across);
+            if (x >= vtexpagecount(vt.width, l) || y >= vtexpagecount(vt.height, l))
+                continue;
+
+            /* read page from the mapped tiles on a worker, stage it where uploads run, copy it into a slot on the render thread */
+            const vtexpage& filepage = vt.pages[vt.fileoffsets[l] + static_cast<std::size_t>(y) * vtexpagecount(vt.width, l) + x];
+            const unsigned char* src = vt.file.data + filepage.offset;
+            std::size_t size = filepage.size;
+            GLenum format = vt.format;
+            vt.loading[page] = 1;
+            ++vt.inflight;
+            submitjob([=]() {
+                std::shared_ptr<std::vector<unsigned char>> data = std::make_shared<std::vector<unsigned char>>(src, src + size);
+                std::shared_ptr<GLuint> staging = std::make_shared<GLuint>(0);
+                submitupload([=]() {
+                    *staging = stagevtexpage(format, data->data(), size);
+                }, [=]() {
+                    vtexture& vt = texreg.vtextures[v];
+                    vt.loading[page] = 0;
+                    --vt.inflight;
+                    if (!reaptex(vt.id))
+                        placevtexpage(vt, page, texreg.texfeedbackframe, *staging);
+                    glDeleteTextures(1, staging.get());
+                });
+            });
+        }
+    }
 
 }
 
-static GLuint genparticlefbo(GLuint particletex) {
-    
-    /* generate and bind fbo */
-    GLuint fbo;
-    glGenFramebuffers(1, &fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+static void streamtextures() {
+
+    /* fence feedback written this frame, or read it back once the gpu is past the fence, writes pause meanwhile */
+    ++texreg.texframe;
+    if (texreg.textures.empty() && texreg.vtextures.empty())
+        return;
+    if (texreg.texfeedbackfence == nullptr)
+        texreg.texfeedbackfence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    else {
+        GLenum state = glClientWaitSync(texreg.texfeedbackfence, 0, 0);
+        if (state == GL_ALREADY_SIGNALED || state == GL_CONDITION_SATISFIED) {
+            glDeleteSync(texreg.texfeedbackfence);
+            texreg.texfeedbackfence = nullptr;
+            std::vector<GLuint> feedback(texreg.textures.size());
+            GLuint none = texstream_nofeedback;
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, texreg.texfeedback);
+            glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, feedback.size() * sizeof(GLuint), feedback.data());
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &none);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            texreg.texfeedbackframe = texreg.texframe;
+            for (std::size_t id = 0; id < texreg.textures.size(); ++id)
+                if (feedback[id] != texstream_nofeedback) {
+                    texreg.textures[id].wanted = std::min<std::uint32_t>(feedback[id], static_cast<std::uint32_t>(texreg.textures[id].source.levels.size()) - 1);
+                    texreg.textures[id].lastused = texreg.texframe;
+                }
+
+            /* virtual pages are read back in the same round */
+            if (texreg.vtexrequests != 0) {
+                std::vector<GLuint> requests((texreg.vtexbits + 31) / 32);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, texreg.vtexrequests);
+                glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, requests.size() * sizeof(GLuint), requests.data());
+                glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+                streampages(requests);
+            }
+        }
+    }
 
-    /* bind texture to framebuffer color attachment */
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, particletex, 0);
-    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    /* republish page tables that changed, once per frame however many pages arrived */
+    for (vtexture& vt : texreg.vtextures)
+        if (vt.dirty)
+            updatevtex(vt);
+
+    /* count levels in flight against the budget */
+    std::size_t inflight = 0, pending = 0;
+    std::vector<std::size_t> candidates;
+    for (std::size_t id = 0; id < texreg.textures.size(); ++id) {
+        const streamtex& st = texreg.textures[id];
+        if (st.streaming) {
+            ++inflight;
+            pending += st.source.levels[st.resident - 1].size;
+        } else if (!st.pinned && !st.unplaced && st.location >= 0 && st.wanted < st.resident)
+            candidates.push_back(id);
+    }
 
-    /* unbind and return fbo */
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    return fbo;
+    /* stream one finer level per texture, most recently used first, evicting least recently used levels to fit */
+    std::sort(candidates.begin(), candidates.end(), [](std::size_t a, std::size_t b) { return texreg.textures[a].lastused > texreg.textures[b].lastused; });
+    for (std::size_t id : candidates) {
+        if (inflight >= texstream_maxinflight)
+            break;
+        streamtex& st = texreg.textures[id];
+        std::uint32_t target = st.resident - 1;
+        std::size_t needed = st.source.levels[target].size;
+        while (texreg.texbytes + pending + needed > texbudget && evicttex(id))
+            ;
+        if (texreg.texbytes + pending + needed > texbudget)
+            break;
+
+        /* page level in from the mapped cache on a worker, stage it where uploads run, copy it into the layer on the render thread */
+        st.streaming = true;
+        ++inflight;
+        pending += needed;
+        const unsigned char* src = st.source.data + st.source.levels[target].offset;
+        texcachelevel level = st.source.levels[target];
+        GLenum format = st.source.format;
+        submitjob([=]() {
+            std::shared_ptr<preparedtex> pt = std::make_shared<preparedtex>();
+            pt->format = format;
+            pt->levels.assign(1, level);
+            pt->levels[0].offset = 0;
+            pt->blob.assign(src, src + needed);
+            pt->data = pt->blob.data();
+            std::shared_ptr<GLuint> staging = std::make_shared<GLuint>(0);
+            submitupload([=]() {
+                *staging = stagetex(*pt, 0);
+            }, [=]() {
+                streamtex& st = texreg.textures[id];
+                st.streaming = false;
+                if (!reaptex(static_cast<GLint>(id)) && st.resident == target + 1 && !placetex(id, target, *staging))
+                    st.unplaced = true;
+                glDeleteTextures(1, staging.get());
+            });
+        });
+    }
 
 }
 
-static void swapparticletex(GLuint& particletex, GLuint& particletex2, GLuint particlefbo) {
+static GLint acquiretex(const std::string& path, std::uint64_t hash, int kind, preparedtex& pt, vtexture& opened, GLuint staging) {
+
+    /* share a registered texture of the same contents, kind and sampler state, dropping the duplicate preparation, the caller deletes staging */
+    bool virtualtex = path.size() > 5 && path.compare(path.size() - 5, 5, ".vtex") == 0;
+    int state[2] = { kind, virtualtex ? texsampler_virtual : texsampler_array };
+    std::uint64_t key = hashbytes(reinterpret_cast<const unsigned char*>(state), sizeof(state), hash);
+    std::unordered_map<std::uint64_t, GLint>::iterator it = texreg.keys.find(key);
+    if (it != texreg.keys.end()) {
+        unmapfile(pt.cache);
+        closevtex(opened);
+        ++texreg.textures[it->second].refs;
+        return it->second;
+    }
+
+    /* virtual textures also need one of the few atlas slots */
+    GLint v = -1;
+    if (virtualtex) {
+        while (++v < static_cast<GLint>(texreg.vtextures.size()) && texreg.vtextures[v].id >= 0)
+            ;
+        if (v == vtex_max) {
+            std::cerr << "too many virtual textures, " << path << " left out" << std::endl;
+            closevtex(opened);
+            return -1;
+        }
+        if (v == static_cast<GLint>(texreg.vtextures.size()))
+            texreg.vtextures.emplace_back();
+    }
 
-    /* swap values */
-    GLuint tmp = particletex, tmp2 = particletex2;
-    particletex = tmp2;
-    particletex2 = tmp;
+    /* register under a free id */
+    GLint id;
+    if (texreg.freeids.empty()) {
+        id = static_cast<GLint>(texreg.textures.size());
+        texreg.textures.emplace_back();
+    } else {
+        id = texreg.freeids.back();
+        texreg.freeids.pop_back();
+    }
+    growtexregistry(texreg.textures.size());
+    texreg.keys[key] = id;
+    streamtex& st = texreg.textures[id];
+    st.key = key;
+    st.refs = 1;
+    st.location = -1;
+    st.vtex = v;
+    st.pinned = virtualtex;
+    st.streaming = false;
+    st.unplaced = false;
+
+    /* start paging or streaming the staged texture */
+    if (virtualtex) {
+        opened.id = id;
+        beginvirtual(v, opened);
+    } else
+        beginstreaming(id, pt, staging);
+    return id;
 
-    /* bind fbo */
-    glBindFramebuffer(GL_FRAMEBUFFER, particlefbo);
+}
 
-    /* bind texture to framebuffer color attachment */
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tmp, 0);
-    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+static void releasetex(GLint id) {
 
-    /* unbind fbo */
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    /* last reference frees it, or whichever worker finishes last */
+    assert(texreg.textures[id].refs > 0);
+    --texreg.textures[id].refs;
+    reaptex(id);
 
 }
 
-/* model data */
+/* per mesh material texture overrides, empty names keep the material's own */
 typedef struct {
-    GLuint vao;
-    GLuint texdiff, texnorm, texspec;
-    int nindices;
-} model;
+    std::string texnames[ntexslots];
+} materialoverride;
 
-/* scene data */
+/* scene import shared between loading job and upload */
 typedef struct {
-    std::unordered_map<std::string, GLuint> texdata;
-    std::vector<model> models;
-    glm::vec3 pos;
-    glm::quat rot;
-    glm::vec3 scale;
-} scene;
-
-/* vertex attribute data */
-#define sz_pos_attrib 3
-#define sz_uv_attrib 2
-#define sz_norm_attrib 3
-#define sz_tng_attrib 3
-#define sz_bitng_attrib 3
-#define sz_total_attrib (sz_pos_attrib + sz_uv_attrib + sz_norm_attrib + sz_tng_attrib + sz_bitng_attrib)
-typedef struct __attribute__((packed)) {
-    float pos[sz_pos_attrib];
-    float uv[sz_uv_attrib];
-    float norm[sz_norm_attrib];
-    float tng[sz_tng_attrib];
-    float bitng[sz_bitng_attrib];
-} attribs;
+    mappedfile cache;
+    std::vector<meshdata> meshes;
+    std::vector<meshview> views;
+    std::vector<packedmesh> packed;
+    std::vector<scenenode> nodes;
+} sceneimport;
 
-/* load scene */
-static scene loadscene(const std::string& filepath, const std::unordered_map<std::string, std::string>& texmap) {
+/* load scene, meshes and textures appear in it as workers finish them */
+static void loadscene(scene& s, const std::string& filepath, const std::unordered_map<std::string, std::string>& texmap, const std::vector<materialoverride>& overrides = std::vector<materialoverride>(), bool packed = false, bool hierarchy = false) {
 
-    /* create scene */
-    scene s;
+    /* init scene */
     s.pos = glm::vec3(0.0f);
     s.rot = glm::identity<glm::quat>();
     s.scale = glm::vec3(1.0f);
 
-    /* load all textures */
-    for (const std::pair<std::string, std::string>& pair : texmap)
-        s.texdata[pair.first] = loadtex(pair.second);
-
-    /* import scene */
-    Assimp::Importer a_importer;
-    a_importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, aiComponent_COLORS | aiComponent_BONEWEIGHTS | aiComponent_ANIMATIONS | aiComponent_TEXTURES | aiComponent_LIGHTS | aiComponent_CAMERAS);
-    const aiScene* a_scene = a_importer.ReadFile(filepath, aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices | aiProcess_Triangulate | aiProcess_RemoveComponent | aiProcess_GenSmoothNormals | aiProcess_PreTransformVertices | aiProcess_RemoveRedundantMaterials);
-    assert(a_scene != nullptr);
-
-    /* load all meshes */
-    for (int i = 0; i < a_scene->mNumMeshes; ++i) {
-        
-        /* create model struct */
-        model m;
-        const aiMesh* a_mesh = a_scene->mMeshes[i];
-
-        /* gen and bind vao & vbo & ibo */
-        GLuint vbo, ibo;
-        glGenVertexArrays(1, &(m.vao));
-        glBindVertexArray(m.vao);
-        glGenBuffers(1, &vbo);
-        glGenBuffers(1, &ibo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-
-        /* build vertices buffer */
-        std::vector<attribs> arrayattribs;
-        arrayattribs.reserve(a_mesh->mNumVertices);
-        attribs* parrayattribs = arrayattribs.data();
-        for (int j = 0; j < a_mesh->mNumVertices; ++j) {
-            parrayattribs[j].pos[0] = a_mesh->mVertices[j].x;
-            parrayattribs[j].pos[1] = a_mesh->mVertices[j].y;
-            parrayattribs[j].pos[2] = a_mesh->mVertices[j].z;
-            if (a_mesh->HasTextureCoords(0)) {
-                parrayattribs[j].uv[0] = a_mesh->mTextureCoords[0][j].x;
-                parrayattribs[j].uv[1] = a_mesh->mTextureCoords[0][j].y;
-            } else
-                parrayattribs[j].uv[0] = parrayattribs[j].uv[1] = 0.0f;
-            parrayattribs[j].norm[0] = a_mesh->mNormals[j].x;
-            parrayattribs[j].norm[1] = a_mesh->mNormals[j].y;
-            parrayattribs[j].norm[2] = a_mesh->mNormals[j].z;
-            parrayattribs[j].tng[0] = a_mesh->mTangents[j].x;
-            parrayattribs[j].tng[1] = a_mesh->mTangents[j].y;
-            parrayattribs[j].tng[2] = a_mesh->mTangents[j].z;
-            parrayattribs[j].bitng[0] = a_mesh->mBitangents[j].x;
-            parrayattribs[j].bitng[1] = a_mesh->mBitangents[j].y;
-            parrayattribs[j].bitng[2] = a_mesh->mBitangents[j].z;
+    /* number textures, they map to no registry texture until acquired */
+    std::unordered_map<std::string, GLint> texids;
+    for (const std::pair<const std::string, std::string>& pair : texmap) {
+        GLint id = static_cast<GLint>(texids.size());
+        texids[pair.first] = id;
+    }
+    std::vector<GLint> unacquired(std::max<std::size_t>(texids.size(), 1), -1);
+    glGenBuffers(1, &s.texremap);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s.texremap);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, unacquired.size() * sizeof(GLint), unacquired.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    s.texrefs.clear();
+
+    /* node matrices are refilled every frame */
+    glGenBuffers(1, &s.nodebuffer);
+
+    /* texture kinds are only known once materials are, promise them to texture jobs */
+    std::shared_ptr<std::unordered_map<std::string, std::promise<int>>> kinds = std::make_shared<std::unordered_map<std::string, std::promise<int>>>();
+    std::unordered_map<std::string, std::shared_future<int>> kindfutures;
+    for (const std::pair<const std::string, std::string>& pair : texmap)
+        kindfutures[pair.first] = (*kinds)[pair.first].get_future().share();
+
+    /* queue mesh job ahead of texture jobs waiting on it */
+    scene* ps = &s;
+    submitjob([=]() {
+
+        /* hash source contents to key the mesh cache */
+        mappedfile source;
+        bool mapped = mapfile(filepath, source);
+        assert(mapped);
+        std::uint64_t hash = hashbytes(source.data, source.size);
+        unmapfile(source);
+
+        /* try mapped mesh cache first, otherwise import, build lod chains and write the cache, each import mode has its own */
+        bool glb = filepath.size() > 4 && filepath.compare(filepath.size() - 4, 4, ".glb") == 0;
+        unsigned int importflags = glb ? scene_glb_import_flags : hierarchy ? scene_hierarchy_import_flags : scene_import_flags;
+        std::string cachepath = filepath + (hierarchy && !glb ? ".hierarchy.meshcache" : ".meshcache");
+        std::shared_ptr<sceneimport> si = std::make_shared<sceneimport>();
+        if (!loadmeshcache(cachepath, hash, importflags, si->cache, si->views, si->nodes)) {
+            if (!glb || !importglb(filepath, si->meshes, si->nodes))
+                importscene(filepath, glb ? scene_hierarchy_import_flags : importflags, si->meshes, si->nodes);
+            for (meshdata& md : si->meshes)
+                genlods(md);
+            writemeshcache(cachepath, hash, importflags, si->meshes, si->nodes);
+            si->views.resize(si->meshes.size());
+            for (std::size_t i = 0; i < si->meshes.size(); ++i) {
+                si->views[i].vertices = si->meshes[i].vertices.data();
+                si->views[i].nvertices = static_cast<std::uint32_t>(si->meshes[i].vertices.size());
+                si->views[i].indices = si->meshes[i].indices.data();
+                si->views[i].nindices = static_cast<std::uint32_t>(si->meshes[i].indices.size() / indexsize(si->meshes[i].indextype));
+                si->views[i].indextype = si->meshes[i].indextype;
+                si->views[i].lods = si->meshes[i].lods;
+                for (int slot = 0; slot < ntexslots; ++slot)
+                    si->views[i].texnames[slot] = si->meshes[i].texnames[slot];
+            }
         }
 
-        /* load vertices buffer, then free vector */
-        glBufferData(GL_ARRAY_BUFFER, a_mesh->mNumVertices * sizeof(attribs), parrayattribs, GL_STATIC_DRAW);
-        arrayattribs.clear();
-
-        /* build indices buffer */
-        std::vector<GLushort> indices;
-        m.nindices = 3 * a_mesh->mNumFaces;
-        indices.reserve(m.nindices);
-        GLushort* pindices = indices.data();
-        for (int j = 0; j < a_mesh->mNumFaces; ++j) {
-            assert(a_mesh->mFaces[j].mNumIndices == 3);
-            pindices[3 * j] = a_mesh->mFaces[j].mIndices[0];
-            pindices[3 * j + 1] = a_mesh->mFaces[j].mIndices[1];
-            pindices[3 * j + 2] = a_mesh->mFaces[j].mIndices[2];
+        /* apply material overrides */
+        for (std::size_t i = 0; i < overrides.size() && i < si->views.size(); ++i)
+            for (int slot = 0; slot < ntexslots; ++slot)
+                if (!overrides[i].texnames[slot].empty())
+                    si->views[i].texnames[slot] = overrides[i].texnames[slot];
+
+        /* pack vertices if requested */
+        if (packed) {
+            si->packed.resize(si->views.size());
+            for (std::size_t i = 0; i < si->views.size(); ++i)
+                packmesh(si->views[i], si->packed[i]);
         }
 
-        /* load indices buffer, then free vector */
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, m.nindices * sizeof(GLushort), pindices, GL_STATIC_DRAW);
-        indices.clear();
+        /* textures used in any normal slot are normal maps, everything else is color */
+        std::unordered_map<std::string, int> resolved;
+        for (const meshview& mv : si->views)
+            if (!mv.texnames[texslot_norm].empty())
+                resolved[mv.texnames[texslot_norm]] = texkind_normal;
+        for (std::pair<const std::string, std::promise<int>>& pair : *kinds)
+            pair.second.set_value(resolved.count(pair.first) > 0 ? resolved[pair.first] : texkind_color);
+
+        /* group meshes into batches, every node referencing a mesh becomes one of its instances */
+        std::shared_ptr<std::vector<batchplan>> plans = std::make_shared<std::vector<batchplan>>();
+        planbatches(si->views, texmap, *plans);
+        std::shared_ptr<std::vector<std::vector<GLuint>>> meshnodes = std::make_shared<std::vector<std::vector<GLuint>>>(si->views.size());
+        for (std::size_t n = 0; n < si->nodes.size(); ++n)
+            for (std::uint32_t mesh : si->nodes[n].meshes)
+                if (mesh < si->views.size())
+                    (*meshnodes)[mesh].push_back(static_cast<GLuint>(n));
+
+        /* split large meshes into clusters */
+        std::shared_ptr<std::vector<std::vector<clusterdata>>> clusters = std::make_shared<std::vector<std::vector<clusterdata>>>(si->views.size());
+        for (std::size_t i = 0; i < si->views.size(); ++i)
+            genclusters(si->views[i], (*clusters)[i]);
+
+        /* bound meshes for culling */
+        std::shared_ptr<std::vector<aabb>> boxes = std::make_shared<std::vector<aabb>>(si->views.size());
+        for (std::size_t i = 0; i < si->views.size(); ++i)
+            for (std::uint32_t v = 0; v < si->views[i].nvertices; ++v) {
+                glm::vec3 pos(si->views[i].vertices[v].pos[0], si->views[i].vertices[v].pos[1], si->views[i].vertices[v].pos[2]);
+                (*boxes)[i].lo = v == 0 ? pos : glm::min((*boxes)[i].lo, pos);
+                (*boxes)[i].hi = v == 0 ? pos : glm::max((*boxes)[i].hi, pos);
+            }
+
+        /* upload batch buffers, then drop cache mapping, vaos are per context and built on render thread */
+        std::shared_ptr<std::vector<drawbatch>> batches = std::make_shared<std::vector<drawbatch>>(plans->size());
+        submitupload([=]() {
+            for (std::size_t p = 0; p < plans->size(); ++p)
+                uploadbatch(si->views, si->packed, texids, *meshnodes, *clusters, (*plans)[p], (*batches)[p]);
+            unmapfile(si->cache);
+            si->meshes.clear();
+            si->packed.clear();
+        }, [=]() {
+            ps->nodes = si->nodes;
+            for (std::size_t p = 0; p < plans->size(); ++p) {
+                drawbatch& b = (*batches)[p];
+                genbatchvao(b);
+                for (std::size_t d = 0; d < b.commands.size(); ++d)
+                    ps->models.push_back({ ps->batches.size(), d, (*boxes)[(*plans)[p].meshes[d]] });
+                ps->batches.push_back(b);
+            }
+            buildbvh(*ps);
+        });
 
-        /* map input attributes */
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-        glEnableVertexAttribArray(2);
-        glEnableVertexAttribArray(3);
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(0, sz_pos_attrib, GL_FLOAT, GL_FALSE, sizeof(attribs), reinterpret_cast<const void*>(0));
-        glVertexAttribPointer(1, sz_uv_attrib, GL_FLOAT, GL_FALSE, sizeof(attribs), reinterpret_cast<const void*>(sz_pos_attrib * sizeof(GLfloat)));
-        glVertexAttribPointer(2, sz_norm_attrib, GL_FLOAT, GL_FALSE, sizeof(attribs), reinterpret_cast<const void*>((sz_pos_attrib + sz_uv_attrib) * sizeof(GLfloat)));
-        glVertexAttribPointer(3, sz_tng_attrib, GL_FLOAT, GL_FALSE, sizeof(attribs), reinterpret_cast<const void*>((sz_pos_attrib + sz_uv_attrib + sz_norm_attrib) * sizeof(GLfloat)));
-        glVertexAttribPointer(4, sz_bitng_attrib, GL_FLOAT, GL_FALSE, sizeof(attribs), reinterpret_cast<const void*>((sz_pos_attrib + sz_uv_attrib + sz_norm_attrib + sz_tng_attrib) * sizeof(GLfloat)));
+    });
+
+    /* hash and prepare textures on workers, preparation decodes before waiting for the kind mesh import resolves, uploads stage their initial levels, the render thread then shares registered ones and registers and publishes the rest, virtual textures are keyed by the image their tiles are cut from */
+    for (const std::pair<const std::string, std::string>& pair : texmap) {
+        GLint local = texids[pair.first];
+        std::string path = pair.second;
+        std::shared_future<int> kind = kindfutures[pair.first];
+        submitjob([=]() {
+            bool virtualtex = path.size() > 5 && path.compare(path.size() - 5, 5, ".vtex") == 0;
+            std::uint64_t hash = 0;
+            bool hassource = hashfile(virtualtex ? path.substr(0, path.size() - 5) : path, hash);
+            assert(hassource || virtualtex);
+            if (!hassource)
+                hash = hashbytes(reinterpret_cast<const unsigned char*>(path.data()), path.size());
+            std::shared_ptr<preparedtex> pt = std::make_shared<preparedtex>();
+            std::shared_ptr<vtexture> vt = std::make_shared<vtexture>();
+            bool prepared = true;
+            if (virtualtex)
+                prepared = openvtex(path, hassource, hash, kind, *vt);
+            else
+                preparetex(path, hash, kind, *pt);
+            if (!prepared)
+                std::cerr << "cannot open virtual texture " << path << std::endl;
+            std::shared_ptr<GLuint> staging = std::make_shared<GLuint>(0);
+            submitupload([=]() {
+                if (!prepared)
+                    return;
+                if (virtualtex)
+                    stagevirtual(*vt);
+                else
+                    *staging = stagetex(*pt, initialresident(*pt));
+            }, [=]() {
+                GLint id = prepared ? acquiretex(path, hash, kind.get(), *pt, *vt, *staging) : -1;
+                glDeleteTextures(1, staging.get());
+                if (id < 0)
+                    return;
+                ps->texrefs.push_back(id);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, ps->texremap);
+                glBufferSubData(GL_SHADER_STORAGE_BUFFER, local * sizeof(GLint), sizeof(GLint), &id);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            });
+        });
+    }
 
-        /* get material ptr */
-        assert(a_mesh->mMaterialIndex < a_scene->mNumMaterials);
-        const aiMaterial* a_mat = a_scene->mMaterials[a_mesh->mMaterialIndex];
-        
-        /* no textures if material is null */
-        if (a_mat == nullptr)
-            m.texdiff = m.texnorm = m.texspec = 0;
-        else {
+}
 
-            /* check if diffuse texture exists and find its handle */
-            if (a_mat->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
-                aiString texname;
-                a_mat->GetTexture(aiTextureType_DIFFUSE, 0, &texname);
-                assert(s.texdata.count(texname.C_Str()) > 0);
-                m.texdiff = s.texdata[texname.C_Str()];
-            } else
-                m.texdiff = 0;
+/* unload scene once nothing is loading into it anymore */
+static void unloadscene(scene& s) {
+
+    /* release textures, the registry frees those no other scene holds */
+    for (GLint id : s.texrefs)
+        releasetex(id);
+    s.texrefs.clear();
+    glDeleteBuffers(1, &s.texremap);
+    s.texremap = 0;
+
+    /* delete batch buffers and vaos */
+    for (drawbatch& b : s.batches) {
+        GLuint buffers[] = { b.vbo, b.ibo, b.instances, b.draws, b.indirect, b.clusters, b.clusterjobs, b.clustercommands, b.clusterinstances };
+        glDeleteBuffers(sizeof(buffers) / sizeof(*buffers), buffers);
+        glDeleteVertexArrays(1, &b.vao);
+    }
+    glDeleteBuffers(1, &s.nodebuffer);
+    s.batches.clear();
+    s.models.clear();
+    s.cullitems.clear();
+    s.bvh.clear();
+    s.nodes.clear();
 
-            /* check if normal texture exists and find its handle */
-            if (a_mat->GetTextureCount(aiTextureType_NORMALS) > 0) {
-                aiString texname;
-                a_mat->GetTexture(aiTextureType_NORMALS, 0, &texname);
-                assert(s.texdata.count(texname.C_Str()) > 0);
-                m.texnorm = s.texdata[texname.C_Str()];
-            } else
-                m.texnorm = 0;
+}
 
-            /* check if specular texture exists and find its handle */
-            if (a_mat->GetTextureCount(aiTextureType_SPECULAR) > 0) {
-                aiString texname;
-                a_mat->GetTexture(aiTextureType_SPECULAR, 0, &texname);
-                assert(s.texdata.count(texname.C_Str()) > 0);
-                m.texspec = s.texdata[texname.C_Str()];
-            } else
-                m.texspec = 0;
+static std::uint32_t picklod(const meshlods& lods, const glm::mat4& world, float pixelsperunit) {
 
-        }
+    /* bounding sphere in world space, scaled by the longest axis */
+    glm::vec3 center(world * glm::vec4(lods.bounds[0], lods.bounds[1], lods.bounds[2], 1.0f));
+    float scale = std::max(std::max(glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1]))), glm::length(glm::vec3(world[2])));
+    float distance = glm::length(center - camerapos) - lods.bounds[3] * scale;
+    if (distance <= 0.0f)
+        return 0;
+
+    /* coarsest level whose projected error stays within tolerance */
+    std::uint32_t level = 0;
+    while (level + 1 < lods.nlods && lods.errors[level + 1] * scale * pixelsperunit / distance <= lod_pixelerror)
+        ++level;
+    return level;
 
-        /* push model */
-        s.models.push_back(m);
+}
 
+static GLuint phongprogram(std::uint32_t features) {
+
+    /* build permutation on first use, warm starts restore it from the program cache */
+    GLuint& program = phong_progs[features];
+    if (program != 0)
+        return program;
+    std::unordered_map<std::string, std::string> vsdefs, fsdefs;
+    const char* slotdefs[ntexslots] = { "hastexdiff", "hastexnorm", "hastexspec" };
+    for (int slot = 0; slot < ntexslots; ++slot)
+        if (features & (1 << slot))
+            fsdefs[slotdefs[slot]] = "1";
+    if (features & phong_feature_virtual)
+        fsdefs["hasvtex"] = "1";
+    if (features & phong_feature_packed)
+        vsdefs["packedvertex"] = "1";
+    program = buildprogram({ { GL_VERTEX_SHADER, "phong_vs.glsl", vsdefs }, { GL_FRAGMENT_SHADER, "phong_fs.glsl", fsdefs } });
+
+    /* texture arrays sit on consecutive units, permutations without texture slots have no samplers */
+    glUseProgram(program);
+    if (features & ((1 << ntexslots) - 1)) {
+        GLint texunits[texarray_maxbuckets];
+        for (int i = 0; i < texarray_maxbuckets; ++i)
+            texunits[i] = i;
+        glUniform1iv(phong_texarrays_uniform, texarray_maxbuckets, texunits);
     }
 
-    /* unbind vao and return scene */
-    glBindVertexArray(0);
-    return s;
+    /* virtual texture atlases and page tables follow them */
+    if (features & phong_feature_virtual) {
+        GLint vtexunits[2 * vtex_max];
+        for (int i = 0; i < 2 * vtex_max; ++i)
+            vtexunits[i] = texarray_maxbuckets + i;
+        glUniform1iv(phong_vtexatlases_uniform, vtex_max, vtexunits);
+        glUniform1iv(phong_vtexpages_uniform, vtex_max, vtexunits + vtex_max);
+    }
+    return program;
 
 }
 
@@ -459,62 +4828,229 @@ static void drawscene(const scene& s) {
     /* build matrices */
     glm::mat4 projView = glm::perspective(glm::pi<float>() / 4.0f, static_cast<float>(width) / height, 0.5f, 25.0f) * glm::lookAt(camerapos, cameracenter, glm::vec3(0.0f, 1.0f, 0.0f));
     glm::mat4 modelMatrix = glm::translate(s.pos) * glm::toMat4(s.rot) * glm::scale(s.scale);
-    glm::mat4 projViewModel = projView * modelMatrix;
-    glm::mat3 modelNormal = glm::transpose(glm::mat3(glm::inverse(modelMatrix)));
 
-    /* use phong program */
-    glUseProgram(phong_prog);
+    /* walk hierarchy below the scene transform, parents come first */
+    std::vector<nodedata> nodes(s.nodes.size());
+    for (std::size_t i = 0; i < s.nodes.size(); ++i) {
+        nodes[i].world = (s.nodes[i].parent < 0 ? modelMatrix : nodes[s.nodes[i].parent].world) * s.nodes[i].local;
+        nodes[i].normal = glm::transpose(glm::inverse(nodes[i].world));
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s.nodebuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<std::size_t>(nodes.size(), 1) * sizeof(nodedata), nodes.empty() ? nullptr : nodes.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, phong_nodes_binding, s.nodebuffer);
+
+    /* cull instances in scene space, the bvh stays valid as the scene transform moves the frustum instead */
+    frustum f;
+    extractfrustum(projView * modelMatrix, f);
+    std::vector<std::vector<char>> visible(s.batches.size());
+    for (std::size_t b = 0; b < s.batches.size(); ++b)
+        visible[b].assign(s.batches[b].instancelist.size(), 0);
+    cullscene(s, f, visible);
+
+    /* cluster culling runs against world space planes */
+    glm::vec4 planes[6];
+    frustumplanes(projView, planes);
+    glUseProgram(cluster_prog);
+    glUniform4fv(cluster_planes_uniform, 6, glm::value_ptr(planes[0]));
+    glUniform3fv(cluster_campos_uniform, 1, glm::value_ptr(camerapos));
+
+    /* prepare all batches before drawing so cluster culling overlaps with the rest */
+    float pixelsperunit = height / (2.0f * std::tan(glm::pi<float>() / 8.0f));
+    std::vector<GLsizei> ncommands(s.batches.size(), 0), nclusters(s.batches.size(), 0);
+    std::vector<drawcommand> commands;
+    std::vector<instancedata> instances;
+    std::vector<clusterjob> jobs;
+    std::vector<std::vector<instancedata>> levels(lod_maxlevels);
+    for (std::size_t bi = 0; bi < s.batches.size(); ++bi) {
+        const drawbatch& b = s.batches[bi];
+
+        /* pick every visible instance's lod, one command per draw and level in use, full detail instances of clustered meshes become cluster jobs */
+        commands.clear();
+        instances.clear();
+        jobs.clear();
+        GLuint maxclusters = 0;
+        for (std::size_t d = 0; d < b.commands.size(); ++d) {
+            const drawcommand& cmd = b.commands[d];
+            const meshlods& lods = b.lods[d];
+            for (std::vector<instancedata>& level : levels)
+                level.clear();
+            for (GLuint i = cmd.baseinstance; i < cmd.baseinstance + cmd.instancecount; ++i) {
+                if (!visible[bi][i])
+                    continue;
+                std::uint32_t level = picklod(lods, nodes[b.instancelist[i].node].world, pixelsperunit);
+                if (level == 0 && b.clustercount[d] > 0) {
+                    clusterjob job = { b.instancelist[i].drawid, b.instancelist[i].node, b.clusterfirst[d], b.clustercount[d], cmd.basevertex, { 0, 0, 0 } };
+                    jobs.push_back(job);
+                    nclusters[bi] += static_cast<GLsizei>(b.clustercount[d]);
+                    maxclusters = std::max(maxclusters, b.clustercount[d]);
+                } else
+                    levels[level].push_back(b.instancelist[i]);
+            }
+            for (std::uint32_t l = 0; l < lods.nlods; ++l) {
+                if (levels[l].empty())
+                    continue;
+                drawcommand lodcmd = { lods.offsets[l + 1] - lods.offsets[l], static_cast<GLuint>(levels[l].size()), cmd.firstindex + lods.offsets[l], cmd.basevertex, static_cast<GLuint>(instances.size()) };
+                commands.push_back(lodcmd);
+                instances.insert(instances.end(), levels[l].begin(), levels[l].end());
+            }
+        }
 
-    /* bind matrix and vector uniforms */
-    glUniformMatrix4fv(phong_projViewModel_uniform, 1, GL_FALSE, glm::value_ptr(projViewModel));
-    glUniformMatrix3fv(phong_modelNormal_uniform, 1, GL_FALSE, glm::value_ptr(modelNormal));
-    glUniformMatrix4fv(phong_model_uniform, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-    glUniform3fv(phong_campos_uniform, 1, glm::value_ptr(camerapos));
-    glUniform3fv(phong_lightpos_uniform, 1, glm::value_ptr(lightpos));
+        /* stream instances and commands, the vao keeps pointing at the instance buffer */
+        ncommands[bi] = static_cast<GLsizei>(commands.size());
+        if (!commands.empty()) {
+            glBindBuffer(GL_ARRAY_BUFFER, b.instances);
+            glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(instancedata), instances.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, b.indirect);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(drawcommand), commands.data(), GL_STREAM_DRAW);
+        }
+        if (jobs.empty())
+            continue;
+
+        /* stream jobs behind a zeroed append counter, one command and instance slot per cluster */
+        GLuint header[4] = { 0, static_cast<GLuint>(jobs.size()), 0, 0 };
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, b.clusterjobs);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(header) + jobs.size() * sizeof(clusterjob), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), header);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(header), jobs.size() * sizeof(clusterjob), jobs.data());
+
+        /* culled clusters leave zeroed commands at the tail, gl 4.3 has no indirect draw count to trim them */
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, b.clustercommands);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, nclusters[bi] * sizeof(drawcommand), nullptr, GL_STREAM_DRAW);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, b.clusterinstances);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, nclusters[bi] * sizeof(instancedata), nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        /* cull clusters, one workgroup row per job */
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, cluster_clusters_binding, b.clusters);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, cluster_jobs_binding, b.clusterjobs);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, cluster_commands_binding, b.clustercommands);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, cluster_instances_binding, b.clusterinstances);
+        glDispatchCompute((maxclusters + cluster_local_size - 1) / cluster_local_size, static_cast<GLuint>(jobs.size()), 1);
 
-    /* draw all models */
-    for (const model& m : s.models) {
+    }
 
-        /* bind diffuse texture */
-        if (m.texdiff == 0)
-            glUniform1i(phong_usetexdiff_uniform, GL_FALSE);
-        else {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, m.texdiff);
-            glUniform1i(phong_texdiff_uniform, 0);
-            glUniform1i(phong_usetexdiff_uniform, GL_TRUE);
-        }
+    /* make cluster commands and instances visible to indirect draws and attribute fetches */
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
 
-        /* bind normal texture */
-        if (m.texnorm == 0)
-            glUniform1i(phong_usetexnorm_uniform, GL_FALSE);
-        else {
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, m.texnorm);
-            glUniform1i(phong_texnorm_uniform, 1);
-            glUniform1i(phong_usetexnorm_uniform, GL_TRUE);
+    /* bind registry texture arrays and table once for all batches, the scene remaps its texture ids into it */
+    for (std::size_t i = 0; i < texreg.texbuckets.size(); ++i) {
+        glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(i));
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texreg.texbuckets[i].array);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, phong_textable_binding, texreg.textable);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, phong_texremap_binding, s.texremap);
+
+    /* bind virtual texture atlases and page tables on the units after the arrays */
+    GLint vtexinfo[4 * vtex_max] = { 0 };
+    for (std::size_t v = 0; v < texreg.vtextures.size(); ++v) {
+        const vtexture& vt = texreg.vtextures[v];
+        glActiveTexture(GL_TEXTURE0 + texarray_maxbuckets + static_cast<GLenum>(v));
+        glBindTexture(GL_TEXTURE_2D, vt.atlas);
+        glActiveTexture(GL_TEXTURE0 + texarray_maxbuckets + vtex_max + static_cast<GLenum>(v));
+        glBindTexture(GL_TEXTURE_2D, vt.pagetable);
+        vtexinfo[4 * v] = vt.width;
+        vtexinfo[4 * v + 1] = vt.height;
+        vtexinfo[4 * v + 2] = vt.nlevels;
+        vtexinfo[4 * v + 3] = static_cast<GLint>(vt.firstbit);
+    }
+    if (texreg.vtexrequests != 0)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, phong_vtexrequests_binding, texreg.vtexrequests);
+
+    /* collect texture feedback unless the last round is still being read back */
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, phong_feedback_binding, texreg.texfeedback);
+    GLint feedback = texreg.texfeedbackfence == nullptr ? GL_TRUE : GL_FALSE;
+
+    /* draw batches grouped by permutation, so programs and their uniforms change once per group */
+    std::vector<std::size_t> order(s.batches.size());
+    for (std::size_t bi = 0; bi < order.size(); ++bi)
+        order[bi] = bi;
+    std::stable_sort(order.begin(), order.end(), [&s](std::size_t a, std::size_t b) { return s.batches[a].features < s.batches[b].features; });
+    std::uint32_t bound = ~0u;
+    for (std::size_t bi : order) {
+        const drawbatch& b = s.batches[bi];
+        if (ncommands[bi] == 0 && nclusters[bi] == 0)
+            continue;
+
+        /* switch permutation, uniforms only exist where the permutation reads them */
+        if (b.features != bound) {
+            bound = b.features;
+            glUseProgram(phongprogram(b.features));
+            glUniformMatrix4fv(phong_projView_uniform, 1, GL_FALSE, glm::value_ptr(projView));
+            glUniform3fv(phong_campos_uniform, 1, glm::value_ptr(camerapos));
+            glUniform3fv(phong_lightpos_uniform, 1, glm::value_ptr(lightpos));
+            if (b.features & ((1 << ntexslots) - 1))
+                glUniform1i(phong_texfeedback_uniform, feedback);
+            if (b.features & phong_feature_virtual)
+                glUniform4iv(phong_vtexinfo_uniform, vtex_max, vtexinfo);
         }
 
-        /* bind specular texture */
-        if (m.texspec == 0)
-            glUniform1i(phong_usetexspec_uniform, GL_FALSE);
-        else {
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, m.texspec);
-            glUniform1i(phong_texspec_uniform, 2);
-            glUniform1i(phong_usetexspec_uniform, GL_TRUE);
-        }
+        /* bind per draw data */
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, phong_draws_binding, b.draws);
 
         /* bind vao */
-        glBindVertexArray(m.vao);
+        glBindVertexArray(b.vao);
 
-        /* draw call */
-        glDrawElements(GL_TRIANGLES, m.nindices, GL_UNSIGNED_SHORT, nullptr);
+        /* draw all models of the batch at once */
+        if (ncommands[bi] > 0) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, b.indirect);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, b.indextype, nullptr, ncommands[bi], 0);
+        }
+
+        /* draw surviving clusters, instance attributes read the culling output meanwhile */
+        if (nclusters[bi] > 0) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, b.clustercommands);
+            glBindVertexBuffer(phong_drawid_attrib, b.clusterinstances, offsetof(instancedata, drawid), sizeof(instancedata));
+            glBindVertexBuffer(phong_node_attrib, b.clusterinstances, offsetof(instancedata, node), sizeof(instancedata));
+            glMultiDrawElementsIndirect(GL_TRIANGLES, b.indextype, nullptr, nclusters[bi], 0);
+            glBindVertexBuffer(phong_drawid_attrib, b.instances, offsetof(instancedata, drawid), sizeof(instancedata));
+            glBindVertexBuffer(phong_node_attrib, b.instances, offsetof(instancedata, node), sizeof(instancedata));
+        }
 
     }
 
-    /* unbind vao */
+    /* unbind vao and indirect buffer */
     glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+}
+
+static glm::vec3 cursorworldpos(double x, double y) {
+
+    /* unproject cursor onto near and far planes */
+    glm::mat4 invProjView = glm::inverse(glm::perspective(glm::pi<float>() / 4.0f, static_cast<float>(width) / height, 0.5f, 25.0f) * glm::lookAt(camerapos, cameracenter, glm::vec3(0.0f, 1.0f, 0.0f)));
+    float ndcx = 2.0f * static_cast<float>(x) / width - 1.0f, ndcy = 1.0f - 2.0f * static_cast<float>(y) / height;
+    glm::vec4 nearpos = invProjView * glm::vec4(ndcx, ndcy, -1.0f, 1.0f), farpos = invProjView * glm::vec4(ndcx, ndcy, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearpos) / nearpos.w, dir = glm::normalize(glm::vec3(farpos) / farpos.w - origin);
+
+    /* intersect cursor ray with plane through camera center facing camera */
+    glm::vec3 normal = glm::normalize(cameracenter - camerapos);
+    return origin + dir * (glm::dot(cameracenter - origin, normal) / glm::dot(dir, normal));
+
+}
+
+static void usage(const char* argv0) {
+
+    /* print options and quit */
+    std::cerr << "usage: " << argv0 << " [options]" << std::endl;
+    std::cerr << "  --load-snapshot file       restore particle state" << std::endl;
+    std::cerr << "  --save-snapshot file       save particle state on exit" << std::endl;
+    std::cerr << "  --prewarm steps            simulate before the first frame" << std::endl;
+    std::cerr << "  --record file              record particle simulation" << std::endl;
+    std::cerr << "  --playback file            play back recorded simulation" << std::endl;
+    std::cerr << "  --integrator name          euler, semi, verlet or rk2" << std::endl;
+    std::cerr << "  --timestep seconds         fixed simulation step, 0 follows frame time" << std::endl;
+    std::cerr << "  --fields file              force field primitives" << std::endl;
+    std::cerr << "  --upload-thread            upload assets from a shared context" << std::endl;
+    std::cerr << "  --packed-vertices          quantize scene vertices to 20 bytes" << std::endl;
+    std::cerr << "  --keep-hierarchy           instance scene meshes per node instead of baking transforms" << std::endl;
+    std::cerr << "  --texture-budget megabytes memory for streamed scene textures" << std::endl;
+    std::cerr << "  --virtual-terrain          page terrain textures from tiled files" << std::endl;
+    std::cerr << "  --pack file                read assets from a pack, loose files fill gaps" << std::endl;
+    std::cerr << "  --build-pack directory     pack assets of directory into the pack file and quit" << std::endl;
+    std::exit(EXIT_FAILURE);
 
 }
 
@@ -523,6 +5059,71 @@ int main(int argc, char** argv) {
     /* seed c random engine */
     std::srand(std::time(nullptr));
 
+    /* parse command line options */
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--upload-thread")
+            uploadthread = true;
+        else if (arg == "--packed-vertices")
+            packvertices = true;
+        else if (arg == "--keep-hierarchy")
+            keephierarchy = true;
+        else if (arg == "--virtual-terrain")
+            virtualterrain = true;
+        else if (i + 1 >= argc)
+            usage(argv[0]);
+        else if (arg == "--load-snapshot")
+            snapshotloadpath = argv[++i];
+        else if (arg == "--save-snapshot")
+            snapshotsavepath = argv[++i];
+        else if (arg == "--prewarm")
+            prewarmsteps = std::atoi(argv[++i]);
+        else if (arg == "--record")
+            recordpath = argv[++i];
+        else if (arg == "--playback")
+            playbackpath = argv[++i];
+        else if (arg == "--integrator") {
+            std::string name = argv[++i];
+            if (name == "euler")
+                integrator = integrator_euler;
+            else if (name == "semi")
+                integrator = integrator_semi;
+            else if (name == "verlet")
+                integrator = integrator_verlet;
+            else if (name == "rk2")
+                integrator = integrator_rk2;
+            else
+                usage(argv[0]);
+        } else if (arg == "--timestep")
+            timestep = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "--fields")
+            fieldspath = argv[++i];
+        else if (arg == "--texture-budget")
+            texbudget = static_cast<std::size_t>(std::atof(argv[++i]) * (1 << 20));
+        else if (arg == "--pack")
+            packpath = argv[++i];
+        else if (arg == "--build-pack")
+            packsourcedir = argv[++i];
+        else
+            usage(argv[0]);
+    }
+
+    /* pack assets offline, before any window exists */
+    if (!packsourcedir.empty()) {
+        std::string outpath = packpath.empty() ? "assets.pack" : packpath;
+        if (!buildpack(packsourcedir, outpath)) {
+            std::cerr << "cannot write pack " << outpath << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    /* map asset pack once, every later read is a view into it */
+    if (!packpath.empty() && !openpack(packpath)) {
+        std::cerr << "cannot open pack " << packpath << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
     /* init glfw lib */
     int result = glfwInit();
     assert(result != GLFW_FALSE);
@@ -536,6 +5137,10 @@ int main(int argc, char** argv) {
     /* hint 4x msaa antialiasing */
     glfwWindowHint(GLFW_SAMPLES, 4);
 
+    /* keep window hidden until the first frame if prewarming */
+    if (prewarmsteps > 0)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
     /* create glfw window */
     window = glfwCreateWindow(width, height, "ra", nullptr, nullptr);
     assert(window != nullptr);
@@ -544,6 +5149,23 @@ int main(int argc, char** argv) {
     /* glad load core 4.3 extensions */
     result = gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress));
     assert(result != 0);
+
+    /* query s3tc once, workers cannot ask without a context */
+    s3tcsupported = glfwExtensionSupported("GL_EXT_texture_compression_s3tc") == GLFW_TRUE;
+
+    /* ask stb_image to flip on y axis, once for all workers */
+    stbi_set_flip_vertically_on_load(true);
+
+    /* hidden context sharing objects with the window, uploads move off the render thread */
+    if (uploadthread) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        loaderwindow = glfwCreateWindow(1, 1, "ra loader", nullptr, window);
+        assert(loaderwindow != nullptr);
+        startloader();
+    }
+
+    /* start loading workers */
+    startworkers();
     
     /* window resize callback */
     glfwSetWindowSizeCallback(window,
@@ -552,14 +5174,28 @@ int main(int argc, char** argv) {
             height = newheight;
         });
 
-    /* cursor callback */
+    /* cursor callback, rotates camera or drags the repulsor while left button is held */
     glfwGetCursorPos(window, &xprev, &yprev);
     glfwSetCursorPosCallback(window,
         [](GLFWwindow*, double x, double y) {
             float dx = x - xprev, dy = y - yprev;
             xprev = x;
             yprev = y;
-            camerapos = glm::rotate(10.0f * dx / width, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(camerapos, 1.0f);
+            if (cursoractive) {
+                cursorpos = cursorworldpos(x, y);
+                cursormoved = true;
+            } else
+                camerapos = glm::rotate(10.0f * dx / width, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(camerapos, 1.0f);
+        });
+
+    /* mouse button callback, toggles cursor repulsor */
+    glfwSetMouseButtonCallback(window,
+        [](GLFWwindow*, int button, int action, int) {
+            if (button != GLFW_MOUSE_BUTTON_LEFT)
+                return;
+            cursoractive = action == GLFW_PRESS;
+            cursorpos = cursorworldpos(xprev, yprev);
+            cursormoved = true;
         });
 
     /* particle shader defines */
@@ -570,48 +5206,58 @@ int main(int argc, char** argv) {
     ss_defs.str("");
     ss_defs << szparticle;
     defs["szparticle"] = ss_defs.str();
+    ss_defs.str("");
+    ss_defs << compute_local_size;
+    defs["localsize"] = ss_defs.str();
+    ss_defs.str("");
+    ss_defs << integrator;
+    defs["integrator"] = ss_defs.str();
+    ss_defs.str("");
+    ss_defs << "vec3(" << fieldgrid_min.x << ", " << fieldgrid_min.y << ", " << fieldgrid_min.z << ")";
+    defs["fieldgridmin"] = ss_defs.str();
+    ss_defs.str("");
+    ss_defs << "vec3(" << fieldgrid_max.x << ", " << fieldgrid_max.y << ", " << fieldgrid_max.z << ")";
+    defs["fieldgridmax"] = ss_defs.str();
+    ss_defs.str("");
+    ss_defs << "ivec3(" << fieldgrid_res.x << ", " << fieldgrid_res.y << ", " << fieldgrid_res.z << ")";
+    defs["fieldgridres"] = ss_defs.str();
 
-    /* compile particle shaders */
-    GLuint particles_vs = compileshader(GL_VERTEX_SHADER, "particles_vs.glsl");
-    GLuint particles_gs = compileshader(GL_GEOMETRY_SHADER, "particles_gs.glsl");
-    GLuint particles_fs = compileshader(GL_FRAGMENT_SHADER, "particles_fs.glsl");
-    GLuint particles_prog = linkprogram({ particles_vs, particles_gs, particles_fs });
+    /* build particle program, warm starts restore it from its binary */
+    GLuint particles_prog = buildprogram({ { GL_VERTEX_SHADER, "particles_vs.glsl", {} }, { GL_GEOMETRY_SHADER, "particles_gs.glsl", {} }, { GL_FRAGMENT_SHADER, "particles_fs.glsl", {} } });
     #define proj_uniform 0
     #define view_uniform 1
     #define model_uniform 2
     #define particleTex_uniform 3
     #define flakeTex_uniform 4
 
-    /* compile compute shaders */
-    GLuint compute_vs = compileshader(GL_VERTEX_SHADER, "compute_vs.glsl");
-    GLuint compute_gs = compileshader(GL_GEOMETRY_SHADER, "compute_gs.glsl");
-    GLuint compute_fs = compileshaderdefs(GL_FRAGMENT_SHADER, "compute_fs.glsl", defs);
-    GLuint compute_prog = linkprogram({ compute_vs, compute_gs, compute_fs });
-    #define deltaTime_uniform 5
-    #define minY_uniform 6
+    /* build compute program */
+    GLuint compute_prog = buildprogram({ { GL_COMPUTE_SHADER, "compute_cs.glsl", defs } });
 
-    /* compile phong shaders */
-    GLuint phong_vs = compileshader(GL_VERTEX_SHADER, "phong_vs.glsl");
-    GLuint phong_fs = compileshader(GL_FRAGMENT_SHADER, "phong_fs.glsl");
-    phong_prog = linkprogram({ phong_vs, phong_fs });
+    /* build cluster culling program */
+    std::unordered_map<std::string, std::string> clusterdefs;
+    ss_defs.str("");
+    ss_defs << cluster_local_size;
+    clusterdefs["localsize"] = ss_defs.str();
+    cluster_prog = buildprogram({ { GL_COMPUTE_SHADER, "cluster_cs.glsl", clusterdefs } });
 
-    /* load terrain */
+    /* load terrain, tiled files are cut from the images next to them when stale */
     std::unordered_map<std::string, std::string> map;
-    map["terraindiff.jpg"] = "terraindiff.jpg";
-    map["terrainnorm.jpg"] = "terrainnorm.jpg";
-    scene terrain = loadscene("terrain.dae", map);
-    terrain.pos = glm::vec3(0.0f, -1.5f, 0.0f);
-    terrain.scale = glm::vec3(20.0f);
+    map["terraindiff.jpg"] = virtualterrain ? "terraindiff.jpg.vtex" : "terraindiff.jpg";
+    map["terrainnorm.jpg"] = virtualterrain ? "terrainnorm.jpg.vtex" : "terrainnorm.jpg";
 
     /* manually set terrain textures (just in case) */
-    assert(terrain.models.size() >= 1);
-    terrain.models[0].texdiff = terrain.texdata["terraindiff.jpg"];
-    terrain.models[0].texnorm = terrain.texdata["terrainnorm.jpg"];
+    std::vector<materialoverride> overrides(1);
+    overrides[0].texnames[texslot_diff] = "terraindiff.jpg";
+    overrides[0].texnames[texslot_norm] = "terrainnorm.jpg";
+
+    /* start loading terrain, it shows up as it arrives */
+    scene terrain;
+    loadscene(terrain, "terrain.dae", map, overrides, packvertices, keephierarchy);
+    terrain.pos = glm::vec3(0.0f, -1.5f, 0.0f);
+    terrain.scale = glm::vec3(20.0f);
 
-    /* compile gradient shaders */
-    GLuint gradient_vs = compileshader(GL_VERTEX_SHADER, "gradient_vs.glsl");
-    GLuint gradient_fs = compileshader(GL_FRAGMENT_SHADER, "gradient_fs.glsl");
-    GLuint gradient_prog = linkprogram({ gradient_vs, gradient_fs });
+    /* build gradient program */
+    GLuint gradient_prog = buildprogram({ { GL_VERTEX_SHADER, "gradient_vs.glsl", {} }, { GL_FRAGMENT_SHADER, "gradient_fs.glsl", {} } });
 
     /* gradient mesh vertices along with color values */
     #define gradcolor0 0.8f,0.91f,1.0f
@@ -651,11 +5297,15 @@ int main(int argc, char** argv) {
     /* load flake texture */
     GLuint flaketex = loadtex("flake.png");
 
-    /* generate particle data textures */
-    GLuint particletex = genparticletex(), particletex2 = genparticletexempty();
+    /* restore particle snapshot if requested, otherwise generate initial data */
+    mappedfile snapshotfile = { nullptr, 0, false };
+    const particle* snapshot = nullptr;
+    if (!snapshotloadpath.empty() && !loadsnapshot(snapshotloadpath, snapshotfile, snapshot))
+        std::cerr << "ignoring missing or incompatible snapshot " << snapshotloadpath << std::endl;
 
-    /* generate particle framebuffer */
-    GLuint particlefbo = genparticlefbo(particletex2);
+    /* generate particle data texture, then drop snapshot mapping */
+    GLuint particletex = genparticletex(snapshot);
+    unmapfile(snapshotfile);
 
     /* create and bind vao */
     GLuint vao;
@@ -666,6 +5316,36 @@ int main(int argc, char** argv) {
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 1, GL_BYTE, GL_FALSE, 0, nullptr);
 
+    /* load force fields and bin them */
+    std::vector<forcefield> fields;
+    if (!fieldspath.empty() && !loadfields(fieldspath, fields)) {
+        std::cerr << "cannot load force fields " << fieldspath << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    uploadfields(fields);
+
+    /* prewarm simulation offscreen in fixed steps, integrating a whole batch per dispatch */
+    #define prewarm_dt (1.0f / 60.0f)
+    #define prewarm_batch 64
+    for (int i = 0; i < prewarmsteps; i += prewarm_batch) {
+        stepparticles(compute_prog, particletex, timestep > 0.0f ? timestep : prewarm_dt, std::min(prewarm_batch, prewarmsteps - i));
+        glFlush();
+    }
+    if (prewarmsteps > 0)
+        glfwShowWindow(window);
+
+    /* start recording or playback if requested */
+    recorder rec;
+    player play;
+    bool recording = !recordpath.empty(), playing = !playbackpath.empty();
+    assert(!(recording && playing));
+    if (recording)
+        beginrecording(rec, recordpath, particletex);
+    if (playing && !beginplayback(play, playbackpath, particletex)) {
+        std::cerr << "cannot play back missing or incompatible recording " << playbackpath << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
     /* enable depth testing */
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
@@ -678,12 +5358,17 @@ int main(int argc, char** argv) {
     /* enable samples (antialiasing) */
     glEnable(GL_MULTISAMPLE);
 
-    /* reset glfw timer */
+    /* reset glfw timer and fixed step accumulator */
     glfwSetTime(0.0);
+    float stepaccum = 0.0f;
 
     /* window event loop */
     while (!glfwWindowShouldClose(window)) {
 
+        /* swap in assets that finished loading */
+        #define upload_budget 0.004
+        drainuploads(upload_budget);
+
         /* set display viewport */
         glViewport(0, 0, width, height);
 
@@ -692,6 +5377,7 @@ int main(int argc, char** argv) {
 
         /* draw terrain */
         drawscene(terrain);
+        streamtextures();
 
         /* bind particle vao */
         glBindVertexArray(vao);
@@ -709,7 +5395,7 @@ int main(int argc, char** argv) {
         
         /* bind display program flake texture */
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, flaketex);
+        glBindTexture(GL_TEXTURE_2D, readytex(flaketex));
         glUniform1i(flakeTex_uniform, 0);
 
         /* bind display program particle data */
@@ -728,41 +5414,66 @@ int main(int argc, char** argv) {
         /* swap buffers */
         glfwSwapBuffers(window);
 
-        /* bind particle fbo */
-        glBindFramebuffer(GL_FRAMEBUFFER, particlefbo);
-
-        /* set compute viewport */
-        glViewport(0, 0, szparticle, nparticles);
-
-        /* bind compute program */
-        glUseProgram(compute_prog);
-
-        /* bind display program particle data */
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_RECTANGLE, particletex);
-        glUniform1i(particleTex_uniform, 0);
+        /* compute new particle values with elapsed time (fixed when recording), then reset glfw timer */
+        float deltatime = recording ? record_dt : static_cast<float>(glfwGetTime());
+        glfwSetTime(0.0);
 
-        /* bind delta time and min y limit */
-        glUniform1f(deltaTime_uniform, static_cast<float>(glfwGetTime()));
-        glUniform1f(minY_uniform, -2.0);
+        /* rebin force fields when the cursor repulsor moved or toggled */
+        if (cursormoved) {
+            std::vector<forcefield> activefields = fields;
+            if (cursoractive) {
+                #define repulsor_strength 6.0f
+                #define repulsor_radius 1.5f
+                forcefield repulsor = { glm::vec4(cursorpos, field_repulsor), glm::vec4(0.0f, 0.0f, 0.0f, repulsor_strength), glm::vec4(repulsor_radius, 0.0f, 0.0f, 0.0f) };
+                activefields.push_back(repulsor);
+            }
+            uploadfields(activefields);
+            cursormoved = false;
+        }
 
-        /* reset glfw timer */
-        glfwSetTime(0.0);
+        if (playing)
+            playbackframe(play, particletex, deltatime);
+        else if (timestep > 0.0f) {
 
-        /* compute new values */
-        glDrawArrays(GL_POINTS, 0, 1);
+            /* integrate whole fixed steps, dropping time that exceeds the substep limit */
+            stepaccum += deltatime;
+            int nsteps = std::min(static_cast<int>(stepaccum / timestep), max_substeps);
+            stepaccum = nsteps == max_substeps ? 0.0f : stepaccum - nsteps * timestep;
+            if (nsteps > 0)
+                stepparticles(compute_prog, particletex, timestep, nsteps);
 
-        /* bind default framebuffer */
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        } else
+            stepparticles(compute_prog, particletex, deltatime);
 
-        /* swap particle textures */
-        swapparticletex(particletex, particletex2, particlefbo);
+        /* record new particle values */
+        if (recording)
+            recordframe(rec, particletex);
 
         /* handle events */
         glfwPollEvents();
     
     }
 
+    /* finish recording or playback */
+    if (recording)
+        endrecording(rec);
+    if (playing)
+        endplayback(play);
+
+    /* save particle snapshot if requested */
+    if (!snapshotsavepath.empty())
+        savesnapshot(snapshotsavepath, particletex);
+
+    /* stop loading workers and loader */
+    stopworkers();
+    if (loaderwindow != nullptr) {
+        stoploader();
+        glfwDestroyWindow(loaderwindow);
+    }
+
+    /* unload terrain, freeing its textures with their last reference */
+    unloadscene(terrain);
+
     /* destroy & deinit */
     glfwDestroyWindow(window);
     glfwTerminate();